@@ -0,0 +1,213 @@
+// Stage benchmarks for the holder pipeline. Sweeps pack sizes, lattices,
+// corner styles and chord tolerances and prints one JSON document with the
+// time, throughput and peak heap of every stage.
+//
+//   CellHolderBench [--max-cells N] [--earcut-max-cells N] [--min-time SEC]
+//                   [--out-dir DIR] [--json FILE]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "cell_layout.h"
+#include "dxf_exporter.h"
+#include "extrusion.h"
+#include "profiler.h"
+#include "stl_exporter.h"
+#include "triangulator.h"
+
+namespace {
+    struct Options {
+        size_t max_cells = size_t(-1);
+        size_t earcut_max_cells = 2000; // whole-plate earcut is super-linear
+        double min_time = 0.05;
+        std::string out_dir = ".";
+        std::string json;
+    };
+
+    struct Stage {
+        std::string name;
+        double seconds = 0.0;
+        size_t iterations = 0;
+        size_t peak_bytes = 0;
+        double cells = 0, triangles = 0, bytes = 0;
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    // Runs fn until min_time has passed (at least once); reports the mean
+    // time per run and the peak heap above the level at stage start.
+    template <typename F>
+    Stage measure(const char* name, double min_time, F&& fn) {
+        Stage s;
+        s.name = name;
+        int64_t base = app::profile::heap_live();
+        app::profile::set_heap_peak(base);
+        auto t0 = Clock::now();
+        double elapsed = 0.0;
+        do {
+            fn();
+            ++s.iterations;
+            elapsed = std::chrono::duration<double>(Clock::now() - t0).count();
+        } while(elapsed < min_time);
+        s.seconds = elapsed / double(s.iterations);
+        s.peak_bytes = size_t(std::max<int64_t>(0, app::profile::heap_peak() - base));
+        return s;
+    }
+
+    size_t file_size(const std::string& path) {
+        std::error_code ec;
+        auto n = std::filesystem::file_size(path, ec);
+        return ec ? 0 : size_t(n);
+    }
+
+    void put_rate(std::FILE* f, const char* key, double amount, double seconds) {
+        if(amount > 0 && seconds > 0) std::fprintf(f, ", \"%s\": %.6g", key, amount / seconds);
+    }
+
+    struct Config { int series, parallel; bool honeycomb, rounded; float chord_tol; };
+
+    void run_config(const Config& c, const Options& o, std::FILE* f, bool first) {
+        const float cell_dia = 21.4f, spacing = 0.5f, wall = 0.5f, height = 10.f;
+        const size_t cells = size_t(c.series) * size_t(c.parallel);
+        std::vector<Stage> stages;
+
+        app::CellLayout::FitResult fit{};
+        stages.push_back(measure("fitRect", o.min_time, [&] {
+            fit = app::CellLayout::fitRect(1e6f, 1e6f, cell_dia, spacing, wall, c.series, c.parallel, c.honeycomb);
+            }));
+        stages.back().cells = double(cells);
+        float W = fit.reqWidth, H = fit.reqHeight;
+
+        app::CellLayout::Layout layout;
+        stages.push_back(measure("rectangleLayout", o.min_time, [&] {
+            layout = app::CellLayout::rectangleLayout(W, H, cell_dia, spacing, wall,
+                c.series, c.parallel, c.chord_tol, c.honeycomb, c.rounded, 5.f);
+            }));
+        stages.back().cells = double(cells);
+
+        geometry::RingSet rings;
+        stages.push_back(measure("rectangleFixed", o.min_time, [&] {
+            rings = app::CellLayout::rectangleFixed(W, H, cell_dia, spacing, wall,
+                c.series, c.parallel, c.chord_tol, c.honeycomb, c.rounded, 5.f);
+            }));
+        stages.back().cells = double(cells);
+
+        if(cells <= o.earcut_max_cells) {
+            std::vector<uint32_t> I;
+            stages.push_back(measure("triangulate", o.min_time, [&] { I = geometry::triangulate(rings); }));
+            stages.back().cells = double(cells);
+            stages.back().triangles = double(I.size() / 3);
+        }
+
+        auto lattice = app::CellLayout::lattice(cell_dia, spacing, wall, c.series, c.parallel, c.honeycomb);
+        geometry::Triangulator triangulator;
+        const geometry::CapTriangulation* cap = nullptr;
+        stages.push_back(measure("triangulate_lattice", o.min_time, [&] {
+            cap = &triangulator.triangulate_lattice(rings, lattice);
+            }));
+        stages.back().cells = double(cells);
+        stages.back().triangles = double(cap->indices.size() / 3);
+
+        geometry::Section section{ rings, cap->indices, cap->extra };
+        size_t tris = geometry::extruded_triangle_count(section);
+        Mesh mesh;
+        stages.push_back(measure("extrude_mesh", o.min_time, [&] { mesh = geometry::extrude_mesh(section, height); }));
+        stages.back().triangles = double(tris);
+
+        std::string stl = o.out_dir + "/bench.stl";
+        stages.push_back(measure("export_ascii", 0.0, [&] { STLExporter::export_ascii(mesh, stl.c_str()); }));
+        stages.back().triangles = double(tris);
+        stages.back().bytes = double(file_size(stl));
+
+        stages.push_back(measure("export_binary", 0.0, [&] { STLExporter::export_binary(mesh, stl.c_str()); }));
+        stages.back().triangles = double(tris);
+        stages.back().bytes = double(file_size(stl));
+        std::filesystem::remove(stl);
+        mesh = Mesh{};
+
+        dxf::Drawing drawing;
+        stages.push_back(measure("busbars_series_groups", o.min_time, [&] {
+            drawing = dxf::busbars_series_groups(layout.centers(), c.series, c.parallel, c.honeycomb, 6.f, 6.f, 6.f, 10.f);
+            }));
+        stages.back().cells = double(cells);
+
+        // the same cells wired in a U, through the spatial hash
+        app::CellLayout::assignSeries(layout, c.series, c.parallel, app::CellLayout::Topology::U);
+        std::vector<int> groups;
+        for(const auto& cell : layout.cells) groups.push_back(cell.group);
+        stages.push_back(measure("busbars_cell_groups", o.min_time, [&] {
+            dxf::busbars_cell_groups(layout.centers(), groups, c.series, 0.5f * cell_dia + 6.f, 10.f, c.chord_tol);
+            }));
+        stages.back().cells = double(cells);
+
+        for(const auto& cell : layout.cells)
+            drawing.circles.push_back({ cell.center.x, cell.center.y, 0.5f * cell_dia, "CELLS" });
+
+        std::string dxfPath = o.out_dir + "/bench.dxf";
+        stages.push_back(measure("dxf_save", 0.0, [&] { dxf::save(drawing, dxfPath.c_str()); }));
+        stages.back().bytes = double(file_size(dxfPath));
+        std::filesystem::remove(dxfPath);
+
+        std::fprintf(f, "%s\n    {\"series\": %d, \"parallel\": %d, \"honeycomb\": %s, \"rounded\": %s, "
+            "\"chord_tol\": %g, \"cells\": %zu, \"triangles\": %zu, \"stages\": [",
+            first ? "" : ",", c.series, c.parallel, c.honeycomb ? "true" : "false",
+            c.rounded ? "true" : "false", double(c.chord_tol), cells, tris);
+        for(size_t i = 0; i < stages.size(); ++i) {
+            const Stage& s = stages[i];
+            std::fprintf(f, "%s\n      {\"stage\": \"%s\", \"seconds\": %.6g, \"iterations\": %zu, \"peak_bytes\": %zu",
+                i ? "," : "", s.name.c_str(), s.seconds, s.iterations, s.peak_bytes);
+            put_rate(f, "cells_per_s", s.cells, s.seconds);
+            put_rate(f, "triangles_per_s", s.triangles, s.seconds);
+            put_rate(f, "bytes_per_s", s.bytes, s.seconds);
+            std::fprintf(f, "}");
+        }
+        std::fprintf(f, "\n    ]}");
+        std::fflush(f);
+    }
+}
+
+int main(int argc, char** argv) {
+    Options o;
+    app::profile::enable();
+    for(int i = 1; i < argc; ++i) {
+        auto arg = [&](const char* name) { return std::strcmp(argv[i], name) == 0 && i + 1 < argc; };
+        if(arg("--max-cells")) o.max_cells = size_t(std::strtoull(argv[++i], nullptr, 10));
+        else if(arg("--earcut-max-cells")) o.earcut_max_cells = size_t(std::strtoull(argv[++i], nullptr, 10));
+        else if(arg("--min-time")) o.min_time = std::atof(argv[++i]);
+        else if(arg("--out-dir")) o.out_dir = argv[++i];
+        else if(arg("--json")) o.json = argv[++i];
+        else {
+            std::fprintf(stderr, "usage: %s [--max-cells N] [--earcut-max-cells N] [--min-time SEC] "
+                "[--out-dir DIR] [--json FILE]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::FILE* f = o.json.empty() ? stdout : std::fopen(o.json.c_str(), "w");
+    if(!f) {
+        std::fprintf(stderr, "cannot open %s\n", o.json.c_str());
+        return 1;
+    }
+
+    const int packs[][2] = { {1,1}, {4,2}, {20,6}, {50,20}, {100,50}, {200,100} };
+    const float tols[] = { 0.05f, 0.01f, 0.005f };
+
+    std::fprintf(f, "{\"results\": [");
+    bool first = true;
+    for(auto& p : packs) {
+        if(size_t(p[0]) * size_t(p[1]) > o.max_cells) continue;
+        for(bool honeycomb : { false, true })
+            for(bool rounded : { false, true })
+                for(float tol : tols) {
+                    run_config({ p[0], p[1], honeycomb, rounded, tol }, o, f, first);
+                    first = false;
+                }
+    }
+    std::fprintf(f, "\n]}\n");
+    if(f != stdout) std::fclose(f);
+    return 0;
+}
\ No newline at end of file
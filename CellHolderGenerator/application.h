@@ -1,6 +1,24 @@
 #pragma once
+#include <memory>
+#include "parameters.h"
+
+namespace app { class Cache; }
 
 class Application {
 public:
-    void run();
-};
\ No newline at end of file
+    // With a cache_dir, layouts, cap triangulations and finished outputs are
+    // kept in an app::Cache there and repeat requests are served from it.
+    explicit Application(const char* cache_dir = nullptr);
+    ~Application();
+
+    // Generates the STL, 3MF and DXF outputs of one holder. Returns false if
+    // the pack does not fit or an output could not be written.
+    bool run(const app::Parameters& p);
+
+    // Runs every job concurrently on the shared thread pool, or one after
+    // another while profiling, and returns the number of jobs that failed.
+    size_t run_batch(const std::vector<app::Parameters>& jobs);
+
+private:
+    std::unique_ptr<app::Cache> cache;
+};
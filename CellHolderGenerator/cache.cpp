@@ -0,0 +1,134 @@
+#include "cache.h"
+#include "output_sink.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+using app::Cache;
+using app::CacheKey;
+
+// Entry layout, all fields native-endian and 8-byte aligned:
+//   magic[8] | u64 key size | key bytes | u64 array count |
+//   per array: u64 byte size | bytes
+static const char magic[8] = { 'C', 'H', 'G', 'C', 'A', 'C', 'H', '1' };
+
+static size_t pad8(size_t n) { return (n + 7) & ~size_t(7); }
+
+uint64_t CacheKey::hash() const {
+    // FNV-1a; collisions are harmless because entries carry the full key
+    uint64_t h = 0xcbf29ce484222325ull;
+    for(unsigned char c : bytes) {
+        h ^= c;
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+Cache::Cache(std::filesystem::path d) : dir(std::move(d)) {
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+}
+
+std::filesystem::path Cache::path_of(const CacheKey& key) const {
+    char name[24];
+    std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key.hash());
+    return dir / name;
+}
+
+std::filesystem::path Cache::file_of(const CacheKey& key) const {
+    return std::filesystem::path(path_of(key)).replace_extension(".out");
+}
+
+// Checksum of a whole output file, eight bytes at a time.
+static uint64_t content_hash(const char* p, size_t n) {
+    uint64_t h = 0xcbf29ce484222325ull ^ n;
+    for(size_t at = 0; at < n; at += 8) {
+        uint64_t w = 0;
+        std::memcpy(&w, p + at, std::min<size_t>(8, n - at));
+        h = (h ^ w) * 0x100000001b3ull;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+// Writes n bytes to path through a sink, so an existing file there is
+// replaced only once the copy is complete.
+static bool write_file(const char* path, const char* p, size_t n) {
+    io::MappedSink sink(path, n);
+    bool ok = n == 0 || sink.write(p, n);
+    return sink.close() && ok;
+}
+
+Cache::Entry Cache::find(const CacheKey& key) const {
+    Entry e;
+    io::MappedFile f(path_of(key).string().c_str());
+    const char* p = f.data();
+    size_t n = f.size(), at = 0;
+
+    auto u64 = [&](uint64_t& v) {
+        if(n - at < 8) return false;
+        std::memcpy(&v, p + at, 8);
+        at += 8;
+        return true;
+    };
+    auto block = [&](std::span<const char>& s) {
+        uint64_t len;
+        if(!u64(len) || len > n - at) return false;
+        s = { p + at, size_t(len) };
+        at = std::min(n, at + pad8(size_t(len)));
+        return true;
+    };
+
+    std::span<const char> stored;
+    uint64_t count;
+    if(n < 8 || std::memcmp(p, magic, 8) != 0) return e;
+    at = 8;
+    if(!block(stored) || stored.size() != key.data().size()
+        || std::memcmp(stored.data(), key.data().data(), stored.size()) != 0) return e;
+    if(!u64(count) || count > (n - at) / 8) return e;
+    e.parts.resize(size_t(count));
+    for(auto& s : e.parts)
+        if(!block(s)) return Entry{};
+    e.file = std::move(f);
+    return e;
+}
+
+bool Cache::store(const CacheKey& key, std::initializer_list<std::span<const char>> arrays) const {
+    size_t size = 8 + 8 + pad8(key.data().size()) + 8;
+    for(const auto& a : arrays) size += 8 + pad8(a.size());
+
+    io::MappedSink sink(path_of(key).string().c_str(), size);
+    const char zeros[8] = {};
+    auto put = [&](std::span<const char> s) {
+        uint64_t len = s.size();
+        sink.write(&len, 8);
+        sink.write(s.data(), s.size());
+        sink.write(zeros, pad8(s.size()) - s.size());
+    };
+    uint64_t count = arrays.size();
+    sink.write(magic, 8);
+    put(key.data());
+    sink.write(&count, 8);
+    for(const auto& a : arrays) put(a);
+    return sink.close();
+}
+
+// The file goes in first and the key entry, holding the file's size and
+// checksum, after it, so a key that is found always has its file.
+bool Cache::store_file(const CacheKey& key, const char* path) const {
+    io::MappedFile f(path);
+    if(!f) return false;
+    uint64_t sum[2] = { f.size(), content_hash(f.data(), f.size()) };
+    if(!write_file(file_of(key).string().c_str(), f.data(), f.size())) return false;
+    return store(key, { std::span<const char>(reinterpret_cast<const char*>(sum), sizeof(sum)) });
+}
+
+// A copy whose size or checksum no longer matches its entry is a miss.
+bool Cache::copy_out(const CacheKey& key, const char* path) const {
+    Entry e = find(key);
+    if(!e || e.arrays() != 1 || e.array<uint64_t>(0).size() != 2) return false;
+    auto sum = e.array<uint64_t>(0);
+    io::MappedFile f(file_of(key).string().c_str());
+    if(f.size() != sum[0] || content_hash(f.data(), f.size()) != sum[1]) return false;
+    return write_file(path, f.data(), f.size());
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <initializer_list>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "mapped_file.h"
+
+namespace app {
+    // Exact bytes of everything a stage result depends on. Values are added
+    // bit for bit, so two keys match only for identical inputs.
+    class CacheKey {
+    public:
+        explicit CacheKey(const char* stage) { add(std::string(stage)); }
+
+        template <typename T>
+        CacheKey& add(const T& v) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            bytes.append(reinterpret_cast<const char*>(&v), sizeof(T));
+            return *this;
+        }
+        CacheKey& add(bool v) { return add(uint8_t(v ? 1 : 0)); }
+        CacheKey& add(const std::string& s) { add(uint64_t(s.size())); bytes += s; return *this; }
+        CacheKey& add(const CacheKey& k) { return add(k.bytes); }
+
+        uint64_t hash() const;
+        const std::string& data() const { return bytes; }
+
+    private:
+        std::string bytes;
+    };
+
+    // Content-addressed store of stage results, one file per key in dir.
+    // An entry holds its full key followed by a list of arrays, each 8-byte
+    // aligned, so a hit is served straight from the mapped file. Entries are
+    // written through io sinks, which rename a finished temporary file into
+    // place, so concurrent jobs and processes can share a directory. Whole
+    // output files are kept verbatim next to an entry holding their key,
+    // size and checksum. Nothing is ever evicted: every distinct input adds
+    // entries until the directory is cleared by hand.
+    class Cache {
+    public:
+        class Entry {
+        public:
+            explicit operator bool() const { return bool(file); }
+            size_t arrays() const { return parts.size(); }
+
+            template <typename T>
+            std::span<const T> array(size_t i) const {
+                return { reinterpret_cast<const T*>(parts[i].data()), parts[i].size() / sizeof(T) };
+            }
+
+        private:
+            friend class Cache;
+            io::MappedFile file;
+            std::vector<std::span<const char>> parts;
+        };
+
+        explicit Cache(std::filesystem::path dir);
+
+        // Mapped entry for key; empty when there is none or it does not match.
+        Entry find(const CacheKey& key) const;
+        bool store(const CacheKey& key, std::initializer_list<std::span<const char>> arrays) const;
+
+        // Whole output files: store_file keeps a copy of the file at path,
+        // copy_out writes the cached copy to path. Both copy rather than
+        // link, so editing an output in place never reaches the cache.
+        // copy_out returns false on a miss, including a cached copy that no
+        // longer matches its checksum, and leaves path untouched then.
+        bool store_file(const CacheKey& key, const char* path) const;
+        bool copy_out(const CacheKey& key, const char* path) const;
+
+    private:
+        std::filesystem::path path_of(const CacheKey& key) const;
+        std::filesystem::path file_of(const CacheKey& key) const;
+
+        std::filesystem::path dir;
+    };
+
+    template <typename T>
+    std::span<const char> as_bytes(const std::vector<T>& v) {
+        return { reinterpret_cast<const char*>(v.data()), v.size() * sizeof(T) };
+    }
+}
@@ -1,13 +1,20 @@
 ﻿#include "cell_layout.h"
+#include "edge_grid.h"
+#include "tessellation.h"
+#include "thread_pool.h"
 #include <cmath>
 #include <algorithm>
+#include <array>
+#include <cstdint>
+#include <span>
 
 using app::CellLayout;
 using FitResult = CellLayout::FitResult;
+using geometry::segs_from_tol;
 
 static inline float vstep_honey(float p) { return p * 0.8660254037844386f; }
 
-static inline float signed_area(const std::vector<Vec2>& p) {
+static inline float signed_area(std::span<const Vec2> p) {
     double a = 0.0;
     for(size_t i = 0, n = p.size(); i < n; ++i) {
         const Vec2& u = p[i];
@@ -17,21 +24,11 @@ static inline float signed_area(const std::vector<Vec2>& p) {
     return float(0.5 * a);
 }
 
-static inline void ensure_orientation(std::vector<Vec2>& p, bool ccw) {
+static inline void ensure_orientation(std::span<Vec2> p, bool ccw) {
     if((signed_area(p) > 0.f) != ccw)
         std::reverse(p.begin(), p.end());
 }
 
-static inline int segs_from_tol(float R, float e, int min_segs = 64, int max_segs = 4096) {
-    if(R <= 0.f) return min_segs;
-    double ee = std::max(1e-6, double(e));
-    double th = 2.0 * std::acos(std::max(0.0, 1.0 - ee / double(R)));
-    if(!std::isfinite(th) || th <= 0.0) return max_segs;
-    int n = int(std::ceil((2.0 * M_PI) / th));
-    n = (n + 3) & ~3;
-    return std::min(std::max(n, min_segs), max_segs);
-}
-
 static inline void append_arc_ccw(std::vector<Vec2>& out, float cx, float cy, float r,
     float a0, float a1, int steps, bool include_start) {
     for(int i = 0; i <= steps; i++) {
@@ -41,9 +38,17 @@ static inline void append_arc_ccw(std::vector<Vec2>& out, float cx, float cy, fl
     }
 }
 
+// Lattice positions in `room` at `step` apart. Clamped before the int
+// conversion so a tiny step or a huge plate can't overflow it.
+static inline int lattice_count(float room, float step) {
+    return std::max(0, int(std::clamp(room / step, -1.f, 1e9f)) + 1);
+}
+
 FitResult CellLayout::fitRect(float width, float height, float cell_dia, float spacing,
     float wall_thickness, int series, int parallel, bool honeycomb) {
     float D = cell_dia, S = spacing, t = wall_thickness, pitch = D + S;
+    // a degenerate lattice or an empty pack fits nothing
+    if(!(pitch > 0.f) || series < 1 || parallel < 1) return { false, 0, 0, 0.f, 0.f, 0.f, 0.f };
     float off = honeycomb ? 0.5f * pitch : 0.f;
     float vstep = honeycomb ? vstep_honey(pitch) : pitch;
 
@@ -58,12 +63,12 @@ FitResult CellLayout::fitRect(float width, float height, float cell_dia, float s
     if(ok) { ms = series; mp = parallel; }
     else {
         if(!honeycomb) {
-            ms = std::max(0, int((width - 2 * t - 2 * (S + 0.5f * D)) / pitch) + 1);
-            mp = std::max(0, int((height - 2 * t - 2 * (S + 0.5f * D)) / pitch) + 1);
+            ms = lattice_count(width - 2 * t - 2 * (S + 0.5f * D), pitch);
+            mp = lattice_count(height - 2 * t - 2 * (S + 0.5f * D), pitch);
         }
         else {
-            ms = std::max(0, int((width - 2 * t - 2 * (S + 0.5f * D) - off) / pitch) + 1);
-            mp = std::max(0, int((height - 2 * t - 2 * (S + 0.5f * D)) / vstep) + 1);
+            ms = lattice_count(width - 2 * t - 2 * (S + 0.5f * D) - off, pitch);
+            mp = lattice_count(height - 2 * t - 2 * (S + 0.5f * D), vstep);
         }
         ms = std::min(ms, series);
         mp = std::min(mp, parallel);
@@ -74,31 +79,148 @@ FitResult CellLayout::fitRect(float width, float height, float cell_dia, float s
              ok ? 0.f : std::max(0.f, reqH - height) };
 }
 
-std::vector<std::vector<Vec2>> CellLayout::rectangleFixed(
-    float width, float height, float cell_dia, float spacing, float wall_thickness,
-    int series, int parallel, float chord_tol_mm, bool honeycomb,
-    bool rounded_corners, float corner_radius
-) {
+std::vector<Vec2> CellLayout::holeTemplate(float cell_dia, float chord_tol_mm) {
+    float R = 0.5f * cell_dia;
+    int segs = segs_from_tol(R, std::max(1e-4f, chord_tol_mm));
+    std::vector<Vec2> hole(segs);
+    for(int i = 0; i < segs; ++i) {
+        float a = 2.f * float(M_PI) * float(i) / float(segs);
+        hole[i] = { R * std::cos(a), R * std::sin(a) };
+    }
+    ensure_orientation(hole, false);
+    return hole;
+}
+
+std::vector<Vec2> CellLayout::collarTemplate(float cell_dia, float spacing) {
+    float Rc = 0.5f * cell_dia + 0.25f * spacing;
+    int segs = segs_from_tol(Rc, 0.125f * spacing, 8, 1 << 16);
+    std::vector<Vec2> collar(segs);
+    for(int i = 0; i < segs; ++i) {
+        float a = 2.f * float(M_PI) * float(i) / float(segs);
+        collar[i] = { Rc * std::cos(a), Rc * std::sin(a) };
+    }
+    ensure_orientation(collar, false);
+    return collar;
+}
+
+geometry::Lattice CellLayout::lattice(float cell_dia, float spacing, float wall_thickness,
+    int series, int parallel, bool honeycomb) {
     float D = cell_dia, S = spacing, t = wall_thickness;
     float R = 0.5f * D, pitch = D + S;
-    float minXc = t + S + R, minYc = t + S + R;
     float off = honeycomb ? 0.5f * pitch : 0.f;
     float vstep = honeycomb ? vstep_honey(pitch) : pitch;
+    return { t + S + R, t + S + R, pitch, vstep, off, R, series, parallel, honeycomb };
+}
 
-    int segs = segs_from_tol(R, std::max(1e-4f, chord_tol_mm));
-    std::vector<Vec2> unit(segs);
-    for(int i = 0; i < segs; ++i) {
-        float a = 2.f * float(M_PI) * float(i) / float(segs);
-        unit[i] = { std::cos(a), std::sin(a) };
+std::vector<Vec2> CellLayout::cellCenters(float cell_dia, float spacing, float wall_thickness,
+    int series, int parallel, bool honeycomb) {
+    auto L = lattice(cell_dia, spacing, wall_thickness, series, parallel, honeycomb);
+
+    std::vector<Vec2> centers;
+    centers.reserve(size_t(std::max(0, series)) * size_t(std::max(0, parallel)));
+    for(int row = 0; row < parallel; ++row) {
+        float cy = L.y0 + row * L.vstep;
+        float rowOffset = (honeycomb && (row % 2)) ? L.offset : 0.f;
+        for(int col = 0; col < series; ++col)
+            centers.push_back({ L.x0 + col * L.pitch + rowOffset, cy });
     }
+    return centers;
+}
+
+std::vector<Vec2> CellLayout::Layout::centers() const {
+    std::vector<Vec2> out;
+    out.reserve(cells.size());
+    for(const Cell& c : cells) out.push_back(c.center);
+    return out;
+}
+
+geometry::RingSet CellLayout::Layout::rings(float chord_tol_mm) const {
+    return rings(holeTemplate(cell_dia, chord_tol_mm));
+}
 
-    std::vector<std::vector<Vec2>> rings;
-    rings.reserve(1 + series * parallel);
+geometry::RingSet CellLayout::Layout::rings(std::span<const Vec2> unit) const {
+    size_t n = cells.size(), segs = unit.size();
 
+    geometry::RingSet rings = boundary;
+    rings.offsets.reserve(rings.offsets.size() + n);
+
+    // hole sizes are known, so the holes are written in parallel into place
+    size_t first = rings.pts.size();
+    rings.pts.resize(first + n * segs);
+    for(size_t i = 0; i < n; ++i)
+        rings.offsets.push_back(uint32_t(first + (i + 1) * segs));
+
+    auto& pool = app::ThreadPool::shared();
+    pool.parallel_for(n, [&](size_t i) {
+        const Vec2& c = cells[i].center;
+        Vec2* dst = rings.pts.data() + first + i * segs;
+        for(size_t k = 0; k < segs; ++k)
+            dst[k] = { c.x + unit[k].x, c.y + unit[k].y };
+        }, pool.grain(n));
+
+    return rings;
+}
+
+bool CellLayout::parseTopology(std::string_view name, Topology& out) {
+    if(name == "columns") out = Topology::Columns;
+    else if(name == "serpentine") out = Topology::Serpentine;
+    else if(name == "u") out = Topology::U;
+    else return false;
+    return true;
+}
+
+void CellLayout::assignSeries(Layout& layout, int series, int parallel, Topology t) {
+    std::vector<Cell>& cells = layout.cells;
+    int lo = INT32_MAX, hi = INT32_MIN;
+    for(const Cell& c : cells) {
+        lo = std::min(lo, c.row);
+        hi = std::max(hi, c.row);
+    }
+    int mid = lo + (hi - lo + 1) / 2;
+
+    // sweep position as (half, column, row), negated where the sweep runs back
+    auto key = [&](const Cell& c) {
+        int half = t == Topology::U && c.row >= mid ? 1 : 0;
+        int col = half ? -c.col : c.col;
+        bool down = t != Topology::Columns && (col & 1);
+        return std::array<int, 3>{ half, col, down ? -c.row : c.row };
+    };
+    std::vector<uint32_t> order(cells.size());
+    for(uint32_t i = 0; i < uint32_t(order.size()); ++i) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return key(cells[a]) < key(cells[b]);
+    });
+
+    size_t wired = size_t(std::max(0, series)) * size_t(std::max(0, parallel));
+    for(size_t k = 0; k < order.size(); ++k)
+        cells[order[k]].group = k < wired ? int(k / size_t(parallel)) : -1;
+}
+
+CellLayout::Layout CellLayout::rectangleLayout(
+    float width, float height, float cell_dia, float spacing, float wall_thickness,
+    int series, int parallel, float chord_tol_mm, bool honeycomb,
+    bool rounded_corners, float corner_radius
+) {
+    Layout layout;
+    layout.cell_dia = cell_dia;
+    std::vector<Vec2> centers = cellCenters(cell_dia, spacing, wall_thickness, series, parallel, honeycomb);
+    layout.cells.reserve(centers.size());
+    for(size_t i = 0; i < centers.size(); ++i) {
+        int row = int(i / size_t(series)), col = int(i % size_t(series));
+        layout.cells.push_back({ centers[i], row, col, col });
+    }
+
+    layout.boundary = plateOutline(width, height, wall_thickness, chord_tol_mm, rounded_corners, corner_radius);
+    return layout;
+}
+
+geometry::RingSet CellLayout::plateOutline(float width, float height, float wall_thickness,
+    float chord_tol_mm, bool rounded_corners, float corner_radius) {
+    float t = wall_thickness;
+    geometry::RingSet rings;
+    std::vector<Vec2>& out = rings.pts;
     if(!rounded_corners) {
-        std::vector<Vec2> outer = { {t,t}, {width - t,t}, {width - t,height - t}, {t,height - t} };
-        ensure_orientation(outer, true);
-        rings.push_back(std::move(outer));
+        out.insert(out.end(), { {t,t}, {width - t,t}, {width - t,height - t}, {t,height - t} });
     }
     else {
         float maxr = 0.5f * std::min(width, height) - t;
@@ -106,34 +228,129 @@ std::vector<std::vector<Vec2>> CellLayout::rectangleFixed(
         int nfull = segs_from_tol(rc, std::max(1e-4f, chord_tol_mm));
         int nquad = std::max(2, nfull / 4);
         float x0 = t, y0 = t, x1 = width - t, y1 = height - t;
-        std::vector<Vec2> outer;
-        outer.reserve(4 * (nquad + 1));
-        outer.push_back({ x0 + rc, y0 });
-        outer.push_back({ x1 - rc, y0 });
-        append_arc_ccw(outer, x1 - rc, y0 + rc, rc, -0.5f * float(M_PI), 0.f, nquad, false);
-        outer.push_back({ x1, y1 - rc });
-        append_arc_ccw(outer, x1 - rc, y1 - rc, rc, 0.f, 0.5f * float(M_PI), nquad, false);
-        outer.push_back({ x0 + rc, y1 });
-        append_arc_ccw(outer, x0 + rc, y1 - rc, rc, 0.5f * float(M_PI), float(M_PI), nquad, false);
-        outer.push_back({ x0, y0 + rc });
-        append_arc_ccw(outer, x0 + rc, y0 + rc, rc, float(M_PI), 1.5f * float(M_PI), nquad, false);
-        ensure_orientation(outer, true);
-        rings.push_back(std::move(outer));
+        out.push_back({ x0 + rc, y0 });
+        out.push_back({ x1 - rc, y0 });
+        append_arc_ccw(out, x1 - rc, y0 + rc, rc, -0.5f * float(M_PI), 0.f, nquad, false);
+        out.push_back({ x1, y1 - rc });
+        append_arc_ccw(out, x1 - rc, y1 - rc, rc, 0.f, 0.5f * float(M_PI), nquad, false);
+        out.push_back({ x0 + rc, y1 });
+        append_arc_ccw(out, x0 + rc, y1 - rc, rc, 0.5f * float(M_PI), float(M_PI), nquad, false);
+        out.push_back({ x0, y0 + rc });
+        append_arc_ccw(out, x0 + rc, y0 + rc, rc, float(M_PI), 1.5f * float(M_PI), nquad, false);
     }
+    rings.end_ring();
+    ensure_orientation(rings[0], true);
+    return rings;
+}
 
-    for(int row = 0; row < parallel; ++row) {
-        float cy = minYc + row * vstep;
-        float rowOffset = (honeycomb && (row % 2)) ? off : 0.f;
-        for(int col = 0; col < series; ++col) {
-            float cx = minXc + col * pitch + rowOffset;
-            std::vector<Vec2> hole;
-            hole.reserve(segs);
-            for(int i = 0; i < segs; ++i)
-                hole.push_back({ cx + R * unit[i].x, cy + R * unit[i].y });
-            ensure_orientation(hole, false);
-            rings.push_back(std::move(hole));
+geometry::RingSet CellLayout::rectangleFixed(
+    float width, float height, float cell_dia, float spacing, float wall_thickness,
+    int series, int parallel, float chord_tol_mm, bool honeycomb,
+    bool rounded_corners, float corner_radius
+) {
+    return rectangleLayout(width, height, cell_dia, spacing, wall_thickness, series, parallel,
+        chord_tol_mm, honeycomb, rounded_corners, corner_radius).rings(chord_tol_mm);
+}
+
+// Lattice over the outline's bounds, seen from the lattice's own axes, and
+// the test of one of its cells against the boundary.
+namespace {
+    struct OutlineLattice {
+        geometry::Lattice L;
+        float cs = 1.f, sn = 0.f;
+
+        Vec2 center(size_t row, size_t col) const {
+            float rowOffset = (L.honeycomb && (row % 2)) ? L.offset : 0.f;
+            Vec2 c{ L.x0 + col * L.pitch + rowOffset, L.y0 + row * L.vstep };
+            if(L.angle == 0.f) return c;
+            return { cs * c.x - sn * c.y, sn * c.x + cs * c.y };
+        }
+    };
+
+    bool outline_lattice(std::span<const Vec2> outer, float cell_dia, float spacing, float wall_thickness,
+        bool honeycomb, CellLayout::Placement place, OutlineLattice& out) {
+        float D = cell_dia, S = spacing, t = wall_thickness;
+        float R = 0.5f * D, pitch = D + S;
+        float off = honeycomb ? 0.5f * pitch : 0.f;
+        float vstep = honeycomb ? vstep_honey(pitch) : pitch;
+        float clear = CellLayout::outlineClearance(D, S, t);
+        out.L = { 0.f, 0.f, pitch, vstep, off, R, 0, 0, honeycomb, place.angle };
+        out.cs = std::cos(place.angle);
+        out.sn = std::sin(place.angle);
+        if(outer.size() < 3 || D <= 0.f) return false;
+
+        // bounds in lattice axes; a center closer than clear to them is
+        // closer than clear to the outline
+        float minx = INFINITY, miny = INFINITY, maxx = -INFINITY, maxy = -INFINITY;
+        for(const Vec2& v : outer) {
+            float x = place.angle == 0.f ? v.x : out.cs * v.x + out.sn * v.y;
+            float y = place.angle == 0.f ? v.y : out.cs * v.y - out.sn * v.x;
+            minx = std::min(minx, x); maxx = std::max(maxx, x);
+            miny = std::min(miny, y); maxy = std::max(maxy, y);
         }
+        float spanx = maxx - minx - 2.f * clear - place.dx, spany = maxy - miny - 2.f * clear - place.dy;
+        if(spanx < 0.f || spany < 0.f) return false;
+        out.L.x0 = minx + clear + place.dx;
+        out.L.y0 = miny + clear + place.dy;
+        out.L.cols = int(spanx / pitch) + 1;
+        out.L.rows = int(spany / vstep) + 1;
+        return true;
     }
 
-    return rings;
-}
\ No newline at end of file
+    bool cell_fits(const geometry::EdgeGrid& grid, Vec2 p, float clear) {
+        return grid.inside(p) && !grid.within(p, clear);
+    }
+}
+
+size_t CellLayout::countOutline(const geometry::RingSet& boundary, const geometry::EdgeGrid& grid,
+    float cell_dia, float spacing, float wall_thickness, bool honeycomb, Placement place) {
+    OutlineLattice O;
+    if(boundary.empty() || !outline_lattice(boundary[0], cell_dia, spacing, wall_thickness, honeycomb, place, O))
+        return 0;
+    float clear = outlineClearance(cell_dia, spacing, wall_thickness);
+    size_t n = 0;
+    for(size_t r = 0; r < size_t(O.L.rows); ++r)
+        for(size_t c = 0; c < size_t(O.L.cols); ++c)
+            n += cell_fits(grid, O.center(r, c), clear);
+    return n;
+}
+
+CellLayout::Packing CellLayout::packOutline(
+    const geometry::RingSet& boundary, float cell_dia, float spacing, float wall_thickness,
+    bool honeycomb, size_t max_cells, Placement place
+) {
+    float clear = outlineClearance(cell_dia, spacing, wall_thickness);
+
+    Packing out;
+    out.layout.cell_dia = cell_dia;
+    geometry::RingSet& rings = out.layout.boundary;
+    for(size_t i = 0; i < boundary.size(); ++i) {
+        if(i > 0 && boundary.count(i) < 3) continue;
+        rings.add_ring(boundary[i]);
+        ensure_orientation(rings[rings.size() - 1], i == 0);
+    }
+    OutlineLattice O;
+    bool any = !rings.empty() && outline_lattice(rings[0], cell_dia, spacing, wall_thickness, honeycomb, place, O);
+    out.lattice = O.L;
+    if(!any || max_cells == 0) return out;
+
+    // candidate cells are independent; the grid keeps each test local
+    geometry::EdgeGrid grid(rings, clear);
+    size_t rows = size_t(O.L.rows), cols = size_t(O.L.cols);
+    std::vector<char> fits(rows * cols, 0);
+    auto& pool = app::ThreadPool::shared();
+    pool.parallel_for(rows, [&](size_t r) {
+        for(size_t c = 0; c < cols; ++c)
+            fits[r * cols + c] = cell_fits(grid, O.center(r, c), clear);
+        }, pool.grain(rows));
+
+    std::vector<Cell>& cells = out.layout.cells;
+    out.cell_ring.assign(rows * cols, -1);
+    for(size_t cell = 0; cell < rows * cols && cells.size() < max_cells; ++cell) {
+        if(!fits[cell]) continue;
+        size_t r = cell / cols, c = cell % cols;
+        out.cell_ring[cell] = int32_t(rings.size() + cells.size());
+        cells.push_back({ O.center(r, c), int(r), int(c), -1 });
+    }
+    return out;
+}
@@ -1,5 +1,12 @@
 #pragma once
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <string_view>
 #include <vector>
+#include "edge_grid.h"
+#include "lattice.h"
+#include "ring_set.h"
 #include "vec2.h"
 
 namespace app {
@@ -25,7 +32,99 @@ namespace app {
             bool honeycomb
         );
 
-        static std::vector<std::vector<Vec2>> rectangleFixed(
+        // Structure-of-arrays candidates for fitRectBatch. push() appends one
+        // candidate to the input columns; the output columns are sized and
+        // filled by fitRectBatch.
+        struct FitBatch {
+            std::vector<float>   width, height, cell_dia, spacing, wall_thickness;
+            std::vector<int>     series, parallel;
+            std::vector<uint8_t> honeycomb;
+
+            std::vector<uint8_t> fits;
+            std::vector<int>     maxSeries, maxParallel;
+            std::vector<float>   reqWidth, reqHeight, deltaWidth, deltaHeight;
+
+            size_t size() const { return width.size(); }
+            void reserve(size_t n);
+            void push(float width, float height, float cell_dia, float spacing,
+                float wall_thickness, int series, int parallel, bool honeycomb);
+        };
+
+        // fitRect for every candidate in b, eight at a time with AVX2 when the
+        // CPU has it and split across the shared thread pool. Results are
+        // bit-identical to calling fitRect per candidate.
+        static void fitRectBatch(FitBatch& b);
+
+        // One placed cell: its center, its row and column on the lattice,
+        // and the series group it is wired into (-1 while it has none).
+        struct Cell {
+            Vec2 center;
+            int  row, col, group;
+        };
+
+        // Where the cells of a holder are, without their geometry. Every
+        // hole is holeTemplate() moved to its cell's center, so consumers
+        // that only need positions (busbars, cell circles, the plate
+        // drawing) read cells, and rings() expands the holes when a mesh or
+        // toolpath needs them.
+        struct Layout {
+            geometry::RingSet boundary; // outline (ccw), then keep-outs (cw)
+            std::vector<Cell> cells;    // in hole order
+            float cell_dia = 0.f;
+
+            std::vector<Vec2> centers() const;
+
+            // boundary followed by one hole per cell; the first hole is
+            // ring boundary.size()
+            geometry::RingSet rings(float chord_tol_mm) const;
+            // The same with hole, centered at the origin, as every hole.
+            geometry::RingSet rings(std::span<const Vec2> hole) const;
+        };
+
+        // Order in which cells are wired into series groups, each group the
+        // next parallel cells along a sweep of the lattice columns. Columns
+        // takes every column bottom to top. Serpentine turns at the end of
+        // each column, so a group that spills over continues next to where
+        // it left off. U sweeps the lower half of the rows out and the upper
+        // half back, bringing both terminals to the same side.
+        enum class Topology { Columns, Serpentine, U };
+
+        // "columns", "serpentine" or "u".
+        static bool parseTopology(std::string_view name, Topology& out);
+
+        // Sets the group of the first series * parallel cells along the
+        // sweep of t; any further cells get -1.
+        static void assignSeries(Layout& layout, int series, int parallel, Topology t);
+
+        // Layout of rectangleFixed: row-major cells, each column one series
+        // group. Only the outline is tessellated.
+        static Layout rectangleLayout(
+            float width,
+            float height,
+            float cell_dia,
+            float spacing,
+            float wall_thickness,
+            int series,
+            int parallel,
+            float chord_tol_mm,
+            bool honeycomb,
+            bool rounded_corners = false,
+            float corner_radius = 5.0f
+        );
+
+        // The plate ring of rectangleLayout: the width x height box inset by
+        // wall_thickness, with corners rounded to corner_radius if asked.
+        static geometry::RingSet plateOutline(
+            float width,
+            float height,
+            float wall_thickness,
+            float chord_tol_mm,
+            bool rounded_corners = false,
+            float corner_radius = 5.0f
+        );
+
+        // rectangleLayout(...).rings(chord_tol_mm)
+        static geometry::RingSet rectangleFixed(
             float width,
             float height,
             float cell_dia,
@@ -38,5 +137,84 @@ namespace app {
             bool rounded_corners = false,
             float corner_radius = 5.0f
         );
+
+        // Cells packed into an arbitrary plate outline.
+        struct Packing {
+            Layout layout;                  // cells have no group yet
+            geometry::Lattice lattice;
+            std::vector<int32_t> cell_ring; // per lattice cell, row-major: ring of its hole in layout.rings() or -1
+        };
+
+        // Where a packing lattice sits: a shift of its anchored origin along
+        // the lattice axes (one pitch by one row step covers every distinct
+        // placement) and a turn of the lattice about the origin, in radians.
+        struct Placement { float dx, dy, angle; };
+
+        // Ring 0 of boundary is the plate outline, any further rings are
+        // keep-outs (bosses, screw posts). The lattice is anchored at the
+        // outline's lower left bound like rectangleFixed's, and a cell is
+        // placed wherever its hole keeps wall_thickness + spacing from the
+        // outline and from every keep-out, at most max_cells of them in
+        // row-major order. Clearance tests go through an EdgeGrid, so the
+        // cost does not grow with outline detail, and no hole is tessellated.
+        static Packing packOutline(
+            const geometry::RingSet& boundary,
+            float cell_dia,
+            float spacing,
+            float wall_thickness,
+            bool honeycomb,
+            size_t max_cells = std::numeric_limits<size_t>::max(),
+            Placement place = { 0.f, 0.f, 0.f }
+        );
+
+        // Cells packOutline would place with no limit, without building any
+        // rings. grid must index every ring of boundary; cell size
+        // outlineClearance() keeps its queries local.
+        static size_t countOutline(
+            const geometry::RingSet& boundary,
+            const geometry::EdgeGrid& grid,
+            float cell_dia,
+            float spacing,
+            float wall_thickness,
+            bool honeycomb,
+            Placement place
+        );
+
+        // Distance a packed cell center keeps from the outline and keep-outs.
+        static float outlineClearance(float cell_dia, float spacing, float wall_thickness) {
+            return 0.5f * cell_dia + wall_thickness + spacing;
+        }
+
+        // Hole ring of one cell centered at the origin, in hole (clockwise)
+        // orientation. Every hole of rectangleFixed is this ring translated
+        // by its cell center.
+        static std::vector<Vec2> holeTemplate(float cell_dia, float chord_tol_mm);
+
+        // Polygon around holeTemplate, clockwise like it, whose corners lie a
+        // quarter spacing outside the hole and whose sides stay an eighth
+        // outside. The collars of neighbouring cells and the plate edge are
+        // all at least half a spacing apart, so a plate with these holes and
+        // a collar ring in each is the holder cut into closed pieces.
+        static std::vector<Vec2> collarTemplate(float cell_dia, float spacing);
+
+        // Lattice the cells of rectangleFixed are placed on.
+        static geometry::Lattice lattice(
+            float cell_dia,
+            float spacing,
+            float wall_thickness,
+            int series,
+            int parallel,
+            bool honeycomb
+        );
+
+        // Cell centers in the same row-major order as the holes of rectangleFixed.
+        static std::vector<Vec2> cellCenters(
+            float cell_dia,
+            float spacing,
+            float wall_thickness,
+            int series,
+            int parallel,
+            bool honeycomb
+        );
     };
 }
\ No newline at end of file
@@ -1,18 +1,21 @@
 #include "dxf_exporter.h"
+#include "output_sink.h"
+#include "point_grid.h"
+#include "profiler.h"
+#include "tessellation.h"
+#include "text_format.h"
+#include "thread_pool.h"
 #include <algorithm>
 #include <cmath>
-#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string_view>
 
 using namespace dxf;
 
-static inline Vec2 centroid(const std::vector<Vec2>& p) {
-    double cx = 0.0, cy = 0.0; size_t n = p.size();
-    for(const auto& v : p) { cx += v.x; cy += v.y; }
-    return { float(cx / double(n)), float(cy / double(n)) };
-}
-
 Drawing dxf::busbars_series_groups(
-    const std::vector<std::vector<Vec2>>& rings,
+    std::span<const Vec2> C,
     int series,
     int parallel,
     bool honeycomb,
@@ -21,11 +24,6 @@ Drawing dxf::busbars_series_groups(
     float weld_diameter,
     float gap_mm
 ) {
-    std::vector<Vec2> C; C.reserve(size_t(series) * size_t(parallel));
-    for(int r = 0; r < parallel; ++r)
-        for(int c = 0; c < series; ++c)
-            C.push_back(centroid(rings[1 + r * series + c]));
-
     Drawing d;
     float r_weld = 0.5f * weld_diameter;
     float halfGap = 0.5f * std::max(0.f, gap_mm);
@@ -63,7 +61,7 @@ Drawing dxf::busbars_series_groups(
             int kind = (g.size() == 1 ? (g[0] == 0 ? -1 : 1) : 0);
             if(kind == -1) {
                 xL = outerL;
-                xR = midX[0] - halfGap;
+                xR = series > 1 ? midX[0] - halfGap : outerR;
             }
             else if(kind == 1) {
                 xL = midX[series - 2] + halfGap;
@@ -169,17 +167,348 @@ Drawing dxf::busbars_series_groups(
     return d;
 }
 
-void dxf::save(const Drawing& d, const char* filename) {
-    std::ofstream out(filename, std::ios::binary);
-    out << "0\nSECTION\n2\nENTITIES\n";
-    for(const auto& pl : d.polylines) {
-        out << "0\nLWPOLYLINE\n8\n" << (pl.layer.empty() ? "0" : pl.layer)
-            << "\n90\n" << int(pl.pts.size()) << "\n70\n" << (pl.closed ? 1 : 0) << "\n";
-        for(const auto& p : pl.pts) { out << "10\n" << p.x << "\n20\n" << p.y << "\n"; }
+// Busbars of arbitrary cell positions. Each wired cell gets its Voronoi
+// region among the cells within 2 * reach, cut to a polygon of radius reach
+// around its center; faces toward cells of another busbar are pulled back
+// by half the gap. A busbar is the union of its cells' regions: every edge
+// that faces the reach limit or another busbar is on the outline, and an
+// edge shared with a cell of the same busbar only where the two regions
+// do not both reach. The outline pieces are then chained end to start.
+namespace {
+    struct Region {
+        std::vector<Vec2> pts;      // convex, counter-clockwise
+        std::vector<int32_t> side;  // bound of the edge from pts[i]: cell index, or -1 for reach
+    };
+
+    // Keeps the part of r with n . x <= d; the new edge is labelled label.
+    void clip(Region& r, Vec2 n, double d, int32_t label) {
+        size_t m = r.pts.size();
+        Region out;
+        out.pts.reserve(m + 1);
+        out.side.reserve(m + 1);
+        auto dist = [&](const Vec2& v) { return double(n.x) * v.x + double(n.y) * v.y - d; };
+        for(size_t i = 0; i < m; ++i) {
+            const Vec2& a = r.pts[i];
+            const Vec2& b = r.pts[(i + 1) % m];
+            double da = dist(a), db = dist(b);
+            if(da <= 0.0) {
+                out.pts.push_back(a);
+                out.side.push_back(r.side[i]);
+            }
+            if((da <= 0.0) != (db <= 0.0)) {
+                double t = da / (da - db);
+                out.pts.push_back({ float(a.x + t * (double(b.x) - a.x)), float(a.y + t * (double(b.y) - a.y)) });
+                out.side.push_back(da <= 0.0 ? label : r.side[i]);
+            }
+        }
+        r = std::move(out);
+    }
+
+    struct Piece { Vec2 a, b; };
+
+    double dist2(Vec2 a, Vec2 b) {
+        double dx = double(a.x) - b.x, dy = double(a.y) - b.y;
+        return dx * dx + dy * dy;
+    }
+
+    // Closed outlines of every busbar (or of busbar only, when it is not
+    // negative); bus[i] is the busbar of cell i, -1 for cells on none.
+    std::vector<std::vector<std::vector<Vec2>>> busbar_outlines(std::span<const Vec2> C,
+        std::span<const int> bus, int buses, float reach, float half_gap, int segs, int only) {
+        size_t n = C.size();
+        geometry::PointGrid grid(C, 2.f * reach);
+        auto& pool = app::ThreadPool::shared();
+        auto wanted = [&](size_t i) { return bus[i] >= 0 && (only < 0 || bus[i] == only); };
+
+        std::vector<Region> regions(n);
+        pool.parallel_for(n, [&](size_t i) {
+            if(!wanted(i)) return;
+            Region& r = regions[i];
+            r.pts.resize(size_t(segs));
+            r.side.assign(size_t(segs), -1);
+            for(int k = 0; k < segs; ++k) {
+                double a = 2.0 * M_PI * double(k) / double(segs);
+                r.pts[k] = { float(C[i].x + reach * std::cos(a)), float(C[i].y + reach * std::sin(a)) };
+            }
+            grid.near(C[i], 2.f * reach, [&](uint32_t j) {
+                if(j == i || r.pts.empty()) return;
+                double ux = double(C[j].x) - C[i].x, uy = double(C[j].y) - C[i].y;
+                double len = std::sqrt(ux * ux + uy * uy);
+                if(len < 1e-6) return;
+                Vec2 u{ float(ux / len), float(uy / len) };
+                double off = bus[j] == bus[i] ? 0.0 : half_gap;
+                clip(r, u, double(u.x) * C[i].x + double(u.y) * C[i].y + 0.5 * len - off, int32_t(j));
+            });
+            }, pool.grain(n));
+
+        // outline pieces per cell, in cell order. Where two reach arcs meet,
+        // their chords cross the shared edge a little apart; pieces shorter
+        // than a quarter chord are dropped and their ends joined instead.
+        float eps = 0.5f * reach * float(std::sin(M_PI / double(segs)));
+        std::vector<std::vector<Piece>> pieces(n);
+        pool.parallel_for(n, [&](size_t i) {
+            if(!wanted(i)) return;
+            const Region& r = regions[i];
+            size_t m = r.pts.size();
+            auto emit = [&](Vec2 a, Vec2 b) {
+                if(dist2(a, b) > double(eps) * eps) pieces[i].push_back({ a, b });
+            };
+            for(size_t k = 0; k < m; ++k) {
+                Vec2 a = r.pts[k], b = r.pts[(k + 1) % m];
+                int32_t j = r.side[k];
+                if(j < 0 || bus[j] != bus[i]) { emit(a, b); continue; }
+
+                // shared with a cell of the same busbar: only what its edge
+                // back to i does not cover
+                const Region& o = regions[j];
+                size_t q = 0, mo = o.pts.size();
+                while(q < mo && o.side[q] != int32_t(i)) ++q;
+                if(q == mo) { emit(a, b); continue; }
+                Vec2 oa = o.pts[q], ob = o.pts[(q + 1) % mo]; // runs from near b to near a
+                double dx = double(b.x) - a.x, dy = double(b.y) - a.y;
+                double len = std::sqrt(dx * dx + dy * dy);
+                if(len <= 0.0) continue;
+                auto t = [&](Vec2 v) { return ((double(v.x) - a.x) * dx + (double(v.y) - a.y) * dy) / len; };
+                double t0 = t(ob), t1 = t(oa);
+                if(t0 >= len || t1 <= 0.0) { emit(a, b); continue; }
+                if(t0 > 0.0) emit(a, ob);
+                if(t1 < len) emit(oa, b);
+            }
+            }, pool.grain(n));
+
+        std::vector<std::vector<std::vector<Vec2>>> out(size_t(std::max(0, buses)));
+        for(int b = 0; b < buses; ++b) {
+            if(only >= 0 && b != only) continue;
+            std::vector<Piece> P;
+            for(size_t i = 0; i < n; ++i)
+                if(bus[i] == b) P.insert(P.end(), pieces[i].begin(), pieces[i].end());
+            std::vector<Vec2> starts(P.size());
+            for(size_t k = 0; k < P.size(); ++k) starts[k] = P[k].a;
+            geometry::PointGrid at(starts, 4.f * eps);
+
+            std::vector<char> used(P.size(), 0);
+            for(size_t s = 0; s < P.size(); ++s) {
+                if(used[s]) continue;
+                std::vector<Vec2> loop;
+                for(size_t cur = s;;) {
+                    used[cur] = 1;
+                    loop.push_back(P[cur].a);
+                    Vec2 end = P[cur].b;
+                    if(loop.size() > 2 && dist2(end, loop.front()) <= double(eps) * eps) break;
+                    size_t next = P.size();
+                    at.near(end, eps, [&](uint32_t k) { if(!used[k]) next = std::min(next, size_t(k)); });
+                    if(next == P.size()) break;
+                    cur = next;
+                }
+
+                // drop points where the outline runs straight on
+                std::vector<Vec2> kept;
+                for(size_t k = 0, m = loop.size(); k < m; ++k) {
+                    const Vec2& p = loop[(k + m - 1) % m];
+                    const Vec2& v = loop[k];
+                    const Vec2& w = loop[(k + 1) % m];
+                    double ax = double(v.x) - p.x, ay = double(v.y) - p.y;
+                    double bx = double(w.x) - v.x, by = double(w.y) - v.y;
+                    double cross = ax * by - ay * bx, dot = ax * bx + ay * by;
+                    if(dot > 0.0 && std::abs(cross) <= 1e-9 * std::sqrt((ax * ax + ay * ay) * (bx * bx + by * by))) continue;
+                    kept.push_back(v);
+                }
+                if(kept.size() >= 3) out[b].push_back(std::move(kept));
+            }
+        }
+        return out;
+    }
+}
+
+Drawing dxf::busbars_cell_groups(std::span<const Vec2> centers, std::span<const int> groups,
+    int series, float reach, float gap_mm, float chord_tol_mm) {
+    Drawing d;
+    if(series <= 0 || centers.empty()) return d;
+    float half_gap = 0.5f * std::max(0.f, gap_mm);
+    int segs = geometry::segs_from_tol(reach, std::max(1e-4f, chord_tol_mm));
+
+    // B- takes group 0, every further busbar the next two groups; with an
+    // even series the last group is B+ alone, with an odd one B+ is on the
+    // other face, where the groups pair up from 0
+    std::vector<int> bus(centers.size());
+    for(size_t i = 0; i < bus.size(); ++i) bus[i] = groups[i] < 0 ? -1 : (groups[i] + 1) / 2;
+    int buses = series / 2 + 1;
+    auto outlines = busbar_outlines(centers, bus, buses, reach, half_gap, segs, -1);
+    for(int b = 0; b < buses; ++b) {
+        const char* layer = b == 0 ? "B-" : (series % 2 == 0 && b == buses - 1 ? "B+" : "BUSBAR");
+        for(auto& loop : outlines[b]) d.polylines.push_back({ std::move(loop), true, layer });
+    }
+    if(series % 2 == 1 && series > 1) {
+        for(size_t i = 0; i < bus.size(); ++i) bus[i] = groups[i] < 0 ? -1 : groups[i] / 2;
+        int last = (series - 1) / 2;
+        auto plus = busbar_outlines(centers, bus, last + 1, reach, half_gap, segs, last);
+        for(auto& loop : plus[last]) d.polylines.push_back({ std::move(loop), true, "B+" });
+    }
+    return d;
+}
+
+Drawing dxf::holder_rect(float width, float height, float wall_thickness,
+    bool rounded_corners, float corner_radius, std::span<const Vec2> centers, float hole_r) {
+    // same outline and corner radius as CellLayout::rectangleFixed,
+    // counter-clockwise from the bottom edge
+    float t = wall_thickness;
+    float x0 = t, y0 = t, x1 = width - t, y1 = height - t;
+    float rc = rounded_corners ? std::max(0.f, std::min(corner_radius, 0.5f * std::min(width, height) - t)) : 0.f;
+
+    Drawing d;
+    Polyline outline{ {}, true, "OUTLINE" };
+    if(rc > 0.f) {
+        const float quarter = float(std::tan(M_PI / 8.0)); // 90 degrees
+        outline.pts = { { x0 + rc, y0 }, { x1 - rc, y0 }, { x1, y0 + rc }, { x1, y1 - rc },
+            { x1 - rc, y1 }, { x0 + rc, y1 }, { x0, y1 - rc }, { x0, y0 + rc } };
+        outline.bulges = { 0.f, quarter, 0.f, quarter, 0.f, quarter, 0.f, quarter };
+    }
+    else outline.pts = { { x0, y0 }, { x1, y0 }, { x1, y1 }, { x0, y1 } };
+    d.polylines.push_back(std::move(outline));
+
+    d.circles.reserve(centers.size());
+    for(const Vec2& c : centers) d.circles.push_back({ c.x, c.y, hole_r, "HOLES" });
+    return d;
+}
+
+Drawing dxf::holder_outline(const geometry::RingSet& boundary,
+    std::span<const Vec2> centers, float hole_r) {
+    Drawing d;
+    for(size_t i = 0; i < boundary.size(); ++i) {
+        auto ring = boundary[i];
+        d.polylines.push_back({ { ring.begin(), ring.end() }, true, "OUTLINE" });
     }
-    for(const auto& c : d.circles) {
-        out << "0\nCIRCLE\n8\n" << (c.layer.empty() ? "0" : c.layer)
-            << "\n10\n" << c.cx << "\n20\n" << c.cy << "\n30\n0\n40\n" << c.r << "\n";
+    d.circles.reserve(centers.size());
+    for(const Vec2& c : centers) d.circles.push_back({ c.x, c.y, hole_r, "HOLES" });
+    return d;
+}
+
+bool dxf::save(const Drawing& d, const char* path) {
+    app::profile::Scope scope("dxf_save");
+    text::Buffer out;
+    out.put("0\nSECTION\n2\nENTITIES\n");
+    text::format_parallel(out, d.polylines.size(), [&](text::Buffer& o, size_t i) {
+        const Polyline& pl = d.polylines[i];
+        o.put("0\nLWPOLYLINE\n8\n"); o.put(pl.layer.empty() ? "0" : pl.layer.c_str());
+        o.put("\n90\n"); o.put(int(pl.pts.size()));
+        o.put("\n70\n"); o.put(pl.closed ? 1 : 0); o.put('\n');
+        for(size_t k = 0; k < pl.pts.size(); ++k) {
+            const Vec2& p = pl.pts[k];
+            o.put("10\n"); o.put(p.x); o.put("\n20\n"); o.put(p.y); o.put('\n');
+            if(k < pl.bulges.size() && pl.bulges[k] != 0.f) { o.put("42\n"); o.put(pl.bulges[k]); o.put('\n'); }
+        }
+        }, 256);
+    text::format_parallel(out, d.circles.size(), [&](text::Buffer& o, size_t i) {
+        const Circle& c = d.circles[i];
+        o.put("0\nCIRCLE\n8\n"); o.put(c.layer.empty() ? "0" : c.layer.c_str());
+        o.put("\n10\n"); o.put(c.cx); o.put("\n20\n"); o.put(c.cy);
+        o.put("\n30\n0\n40\n"); o.put(c.r); o.put('\n');
+        });
+    out.put("0\nENDSEC\n0\nEOF\n");
+
+    io::MappedSink sink(path, out.size());
+    sink.write(out.data(), out.size());
+    return sink.close();
+}
+
+namespace {
+    // Binary DXF group writer over a pre-sized buffer. Strings end in a
+    // null byte; codes 10-59 are doubles, 60-79 int16 and 90-99 int32.
+    struct BinaryGroups {
+        char* p;
+
+        template <typename T>
+        void raw(T v) { std::memcpy(p, &v, sizeof(v)); p += sizeof(v); }
+        void str(uint16_t code, std::string_view s) {
+            raw(code);
+            std::memcpy(p, s.data(), s.size());
+            p += s.size();
+            *p++ = 0;
+        }
+        void real(uint16_t code, double v) { raw(code); raw(v); }
+        void i16(uint16_t code, int16_t v) { raw(code); raw(v); }
+        void i32(uint16_t code, int32_t v) { raw(code); raw(v); }
+
+        static size_t str_size(std::string_view s) { return 2 + s.size() + 1; }
+        static constexpr size_t real_size = 10, i16_size = 4, i32_size = 6;
+    };
+
+    std::string_view layer_of(const std::string& layer) { return layer.empty() ? "0" : std::string_view(layer); }
+
+    size_t binary_size(const Polyline& pl) {
+        size_t bulges = 0;
+        for(size_t k = 0; k < pl.pts.size(); ++k) bulges += k < pl.bulges.size() && pl.bulges[k] != 0.f;
+        return BinaryGroups::str_size("LWPOLYLINE") + BinaryGroups::str_size(layer_of(pl.layer))
+            + BinaryGroups::i32_size + BinaryGroups::i16_size
+            + (2 * pl.pts.size() + bulges) * BinaryGroups::real_size;
+    }
+
+    size_t binary_size(const Circle& c) {
+        return BinaryGroups::str_size("CIRCLE") + BinaryGroups::str_size(layer_of(c.layer)) + 4 * BinaryGroups::real_size;
+    }
+}
+
+bool dxf::save_binary(const Drawing& d, const char* path) {
+    app::profile::Scope scope("dxf_save");
+    static const char sentinel[] = "AutoCAD Binary DXF\r\n\x1a"; // and its terminating null
+    const size_t head = sizeof(sentinel)
+        + BinaryGroups::str_size("SECTION") + BinaryGroups::str_size("HEADER")
+        + BinaryGroups::str_size("$ACADVER") + BinaryGroups::str_size("AC1015") + BinaryGroups::str_size("ENDSEC")
+        + BinaryGroups::str_size("SECTION") + BinaryGroups::str_size("ENTITIES");
+    const size_t tail = BinaryGroups::str_size("ENDSEC") + BinaryGroups::str_size("EOF");
+
+    // entity offsets first, so every entity knows where it goes
+    size_t np = d.polylines.size(), nc = d.circles.size();
+    std::vector<size_t> at(np + nc + 1);
+    at[0] = head;
+    for(size_t i = 0; i < np; ++i) at[i + 1] = at[i] + binary_size(d.polylines[i]);
+    for(size_t i = 0; i < nc; ++i) at[np + i + 1] = at[np + i] + binary_size(d.circles[i]);
+    size_t total = at[np + nc] + tail;
+
+    io::MappedSink sink(path, total);
+    if(!sink.ok()) {
+        sink.close();
+        return false;
     }
-    out << "0\nENDSEC\n0\nEOF\n";
+    char* base = sink.map();
+
+    BinaryGroups g{ base };
+    std::memcpy(g.p, sentinel, sizeof(sentinel));
+    g.p += sizeof(sentinel);
+    g.str(0, "SECTION"); g.str(2, "HEADER");
+    g.str(9, "$ACADVER"); g.str(1, "AC1015");
+    g.str(0, "ENDSEC");
+    g.str(0, "SECTION"); g.str(2, "ENTITIES");
+
+    auto& pool = app::ThreadPool::shared();
+    pool.parallel_for(np + nc, [&](size_t i) {
+        BinaryGroups e{ base + at[i] };
+        if(i < np) {
+            const Polyline& pl = d.polylines[i];
+            e.str(0, "LWPOLYLINE");
+            e.str(8, layer_of(pl.layer));
+            e.i32(90, int32_t(pl.pts.size()));
+            e.i16(70, pl.closed ? 1 : 0);
+            for(size_t k = 0; k < pl.pts.size(); ++k) {
+                e.real(10, pl.pts[k].x);
+                e.real(20, pl.pts[k].y);
+                if(k < pl.bulges.size() && pl.bulges[k] != 0.f) e.real(42, pl.bulges[k]);
+            }
+        }
+        else {
+            const Circle& c = d.circles[i - np];
+            e.str(0, "CIRCLE");
+            e.str(8, layer_of(c.layer));
+            e.real(10, c.cx);
+            e.real(20, c.cy);
+            e.real(30, 0.0);
+            e.real(40, c.r);
+        }
+    }, pool.grain(np + nc));
+
+    g.p = base + at[np + nc];
+    g.str(0, "ENDSEC");
+    g.str(0, "EOF");
+    sink.commit(total);
+    return sink.close();
 }
\ No newline at end of file
@@ -1,10 +1,14 @@
 #pragma once
+#include <span>
 #include <vector>
 #include <string>
+#include "ring_set.h"
 #include "vec2.h"
 
 namespace dxf {
-    struct Polyline { std::vector<Vec2> pts; bool closed; std::string layer; };
+    // bulges[i], when given, turns the segment from pts[i] to the next point
+    // into an arc: tan(included angle / 4), positive counter-clockwise.
+    struct Polyline { std::vector<Vec2> pts; bool closed; std::string layer; std::vector<float> bulges = {}; };
     struct Circle { float cx, cy, r; std::string layer; };
 
     struct Drawing {
@@ -12,8 +16,11 @@ namespace dxf {
         std::vector<Circle>   circles;
     };
 
+    // Busbar outlines for a series x parallel rectangle. centers are the
+    // cell centers in row-major order, series per row; each column is one
+    // series group.
     Drawing busbars_series_groups(
-        const std::vector<std::vector<Vec2>>& rings,
+        std::span<const Vec2> centers,
         int series,
         int parallel,
         bool honeycomb,
@@ -23,5 +30,36 @@ namespace dxf {
         float gap_mm
     );
 
-    void save(const Drawing& d, const char* filename);
+    // Busbar outlines for cells at any positions, wired by series group:
+    // groups[i] is the group of cell i, 0 to series - 1, or -1 for a cell on
+    // no busbar. B- takes group 0 and every BUSBAR the next two groups; with
+    // an even series the last group is B+, with an odd one B+ is drawn for
+    // the last group alone, as on the other face. A busbar covers its
+    // cells' Voronoi regions out to reach from their centers, kept gap_mm
+    // from every other busbar, with the reach arcs chorded to chord_tol_mm.
+    // Neighbours are found through a PointGrid, so the cost grows with the
+    // cell count, not its square.
+    Drawing busbars_cell_groups(std::span<const Vec2> centers, std::span<const int> groups,
+        int series, float reach, float gap_mm, float chord_tol_mm);
+
+    // Cut drawing of a width x height plate: the outline inset by
+    // wall_thickness on layer OUTLINE, with bulge arcs for rounded corners,
+    // and a CIRCLE of hole_r on layer HOLES per cell center. Built from the
+    // layout parameters, so nothing is tessellated.
+    Drawing holder_rect(float width, float height, float wall_thickness,
+        bool rounded_corners, float corner_radius, std::span<const Vec2> centers, float hole_r);
+
+    // The same for a packed outline: the rings of boundary (outline and
+    // keep-outs) are copied as closed polylines, the cells become circles.
+    Drawing holder_outline(const geometry::RingSet& boundary,
+        std::span<const Vec2> centers, float hole_r);
+
+    // Text DXF: an ENTITIES section of LWPOLYLINE and CIRCLE entities.
+    bool save(const Drawing& d, const char* path);
+
+    // The same entities as binary DXF (R2000 group codes, 2 bytes each,
+    // little-endian values, full double precision). The size is computed
+    // first, and the entities are written in parallel into a file mapped
+    // at that size.
+    bool save_binary(const Drawing& d, const char* path);
 }
\ No newline at end of file
@@ -0,0 +1,397 @@
+#include "dxf_reader.h"
+#include "edge_grid.h"
+#include "mapped_file.h"
+#include "profiler.h"
+#include "tessellation.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+using dxf::Outline;
+
+namespace {
+    std::string_view trim(const char* b, const char* e) {
+        while(b < e && (*b == ' ' || *b == '\t')) ++b;
+        while(e > b && (e[-1] == ' ' || e[-1] == '\t' || e[-1] == '\r')) --e;
+        return { b, size_t(e - b) };
+    }
+
+    bool same_name(std::string_view a, std::string_view b) {
+        if(a.size() != b.size()) return false;
+        for(size_t i = 0; i < a.size(); ++i)
+            if(std::toupper((unsigned char)a[i]) != std::toupper((unsigned char)b[i])) return false;
+        return true;
+    }
+
+    // Group code / value pairs read straight off the mapped bytes.
+    class Pairs {
+    public:
+        Pairs(const char* p, size_t n) : at(p), end(p + n) {}
+
+        bool next(int& code, std::string_view& value) {
+            std::string_view c;
+            if(!line(c) || !line(value)) return false;
+            auto [e, ec] = std::from_chars(c.data(), c.data() + c.size(), code);
+            return ec == std::errc() && e == c.data() + c.size();
+        }
+
+        size_t line_number() const { return lines; }
+
+    private:
+        bool line(std::string_view& s) {
+            if(at >= end) return false;
+            const char* nl = static_cast<const char*>(std::memchr(at, '\n', size_t(end - at)));
+            const char* e = nl ? nl : end;
+            s = trim(at, e);
+            at = nl ? nl + 1 : end;
+            ++lines;
+            return true;
+        }
+
+        const char* at;
+        const char* end;
+        size_t lines = 0;
+    };
+
+    struct Vertex { double x, y, bulge; };
+
+    // Fields of the entity being read; only the ones its type uses are set.
+    struct Entity {
+        std::string_view type, layer;
+        double x[2] = {}, y[2] = {};
+        double r = 0.0, a0 = 0.0, a1 = 0.0, bulge = 0.0, nz = 1.0;
+        int flags = 0;
+        std::vector<Vertex> verts;
+
+        void reset(std::string_view t) {
+            type = t;
+            layer = {};
+            x[0] = x[1] = y[0] = y[1] = 0.0;
+            r = a0 = a1 = bulge = 0.0;
+            nz = 1.0;
+            flags = 0;
+            verts.clear();
+        }
+    };
+
+    // Turns entities into closed rings and open pieces as they are read.
+    class Builder {
+    public:
+        explicit Builder(float tol) : tol(double(tol)) {}
+
+        geometry::RingSet closed;
+        geometry::RingSet pieces;
+
+        void polyline(const std::vector<Vertex>& v, bool closed_flag, bool mirror) {
+            if(v.empty()) return;
+            pts.clear();
+            size_t n = v.size(), edges = closed_flag ? n : n - 1;
+            for(size_t i = 0; i < n; ++i) {
+                add(v[i].x, v[i].y, mirror);
+                if(i < edges && v[i].bulge != 0.0) bulge_arc(v[i], v[(i + 1) % n], mirror);
+            }
+            finish(closed_flag);
+        }
+
+        void line(double x0, double y0, double x1, double y1) {
+            pts.clear();
+            add(x0, y0, false);
+            add(x1, y1, false);
+            finish(false);
+        }
+
+        // Counter-clockwise from a0 to a1 degrees; a full turn for a circle.
+        void arc(double cx, double cy, double r, double a0, double a1, bool full, bool mirror) {
+            if(!(r > 0.0)) return;
+            double sweep = full ? 360.0 : std::fmod(a1 - a0, 360.0);
+            if(sweep <= 0.0) sweep += 360.0;
+            int n = arc_segments(r, sweep);
+            pts.clear();
+            for(int i = 0; i <= n - (full ? 1 : 0); ++i) {
+                double a = (a0 + sweep * double(i) / double(n)) * (M_PI / 180.0);
+                add(cx + r * std::cos(a), cy + r * std::sin(a), mirror);
+            }
+            finish(full);
+        }
+
+    private:
+        int arc_segments(double r, double sweep) const {
+            int full = geometry::segs_from_tol(float(r), float(tol));
+            return std::max(1, int(std::ceil(double(full) * sweep / 360.0)));
+        }
+
+        // Interior points of the arc a polyline bulge puts between p and q.
+        void bulge_arc(const Vertex& p, const Vertex& q, bool mirror) {
+            double dx = q.x - p.x, dy = q.y - p.y, d = std::hypot(dx, dy);
+            if(d <= 0.0) return;
+            double theta = 4.0 * std::atan(p.bulge);
+            double h = 0.5 * d / std::tan(0.5 * theta);
+            double cx = 0.5 * (p.x + q.x) - h * dy / d, cy = 0.5 * (p.y + q.y) + h * dx / d;
+            double r = std::hypot(p.x - cx, p.y - cy);
+            double start = std::atan2(p.y - cy, p.x - cx);
+            int n = arc_segments(r, std::fabs(theta) * (180.0 / M_PI));
+            for(int i = 1; i < n; ++i) {
+                double a = start + theta * double(i) / double(n);
+                add(cx + r * std::cos(a), cy + r * std::sin(a), mirror);
+            }
+        }
+
+        void add(double x, double y, bool mirror) {
+            Vec2 v{ float(mirror ? -x : x), float(y) };
+            if(!pts.empty() && pts.back().x == v.x && pts.back().y == v.y) return;
+            pts.push_back(v);
+        }
+
+        void finish(bool closed_flag) {
+            if(pts.size() > 1 && std::hypot(double(pts.back().x) - pts[0].x, double(pts.back().y) - pts[0].y) <= tol) {
+                pts.pop_back();
+                closed_flag = true;
+            }
+            if(closed_flag) {
+                if(pts.size() >= 3) closed.add_ring(pts);
+            }
+            else if(pts.size() >= 2) pieces.add_ring(pts);
+        }
+
+        double tol;
+        std::vector<Vec2> pts;
+    };
+
+    double area(std::span<const Vec2> p) {
+        double a = 0.0;
+        for(size_t i = 0, n = p.size(); i < n; ++i)
+            a += double(p[i].x) * p[(i + 1) % n].y - double(p[i].y) * p[(i + 1) % n].x;
+        return 0.5 * a;
+    }
+
+    bool inside(std::span<const Vec2> poly, Vec2 p) {
+        bool in = false;
+        for(size_t i = 0, j = poly.size() - 1; i < poly.size(); j = i++) {
+            const Vec2& a = poly[i];
+            const Vec2& b = poly[j];
+            if((a.y > p.y) != (b.y > p.y)) {
+                double x = double(a.x) + (double(p.y) - a.y) * (double(b.x) - a.x) / (double(b.y) - a.y);
+                if(double(p.x) < x) in = !in;
+            }
+        }
+        return in;
+    }
+
+    // Joins open pieces whose ends meet within tol into closed rings.
+    // Returns the number of chains left open.
+    size_t chain(const geometry::RingSet& pieces, double tol, geometry::RingSet& closed) {
+        size_t n = pieces.size();
+        if(n == 0) return 0;
+        double cell = std::max(tol, 1e-9);
+        auto key = [&](Vec2 v, int dx, int dy) {
+            int64_t kx = int64_t(std::floor(double(v.x) / cell)) + dx;
+            int64_t ky = int64_t(std::floor(double(v.y) / cell)) + dy;
+            return (uint64_t(kx) << 32) ^ uint64_t(uint32_t(ky));
+        };
+        auto end_of = [&](size_t e) {
+            auto r = pieces[e / 2];
+            return (e & 1) ? r.back() : r.front();
+        };
+        // endpoints sorted by grid key; a lookup scans the 3x3 keys around a point
+        std::vector<std::pair<uint64_t, uint32_t>> ends(2 * n);
+        for(uint32_t e = 0; e < 2 * n; ++e) ends[e] = { key(end_of(e), 0, 0), e };
+        std::sort(ends.begin(), ends.end());
+
+        std::vector<char> used(n, 0);
+        auto near = [&](Vec2 a, Vec2 b) { return std::hypot(double(a.x) - b.x, double(a.y) - b.y) <= tol; };
+        // the point's own key first: matching ends almost always share it
+        static const int around[9][2] = { {0,0}, {-1,-1}, {0,-1}, {1,-1}, {-1,0}, {1,0}, {-1,1}, {0,1}, {1,1} };
+        auto find_end = [&](Vec2 v) -> int64_t {
+            for(const auto& d : around) {
+                uint64_t k = key(v, d[0], d[1]);
+                auto it = std::lower_bound(ends.begin(), ends.end(), std::pair<uint64_t, uint32_t>(k, 0));
+                for(; it != ends.end() && it->first == k; ++it)
+                    if(!used[it->second / 2] && near(end_of(it->second), v)) return it->second;
+            }
+            return -1;
+        };
+
+        size_t open = 0;
+        std::vector<Vec2> ring;
+        for(size_t s = 0; s < n; ++s) {
+            if(used[s]) continue;
+            used[s] = 1;
+            auto first = pieces[s];
+            ring.assign(first.begin(), first.end());
+            bool closes = false;
+            for(;;) {
+                if(ring.size() > 2 && near(ring.back(), ring.front())) { closes = true; break; }
+                int64_t e = find_end(ring.back());
+                if(e < 0) break;
+                used[size_t(e) / 2] = 1;
+                auto next = pieces[size_t(e) / 2];
+                if(e & 1) ring.insert(ring.end(), next.rbegin() + 1, next.rend());
+                else ring.insert(ring.end(), next.begin() + 1, next.end());
+            }
+            if(!closes) { ++open; continue; }
+            ring.pop_back();
+            if(ring.size() >= 3) closed.add_ring(ring);
+        }
+        return open;
+    }
+}
+
+bool dxf::read_outline(const char* path, float chord_tol_mm, std::string_view layer,
+    Outline& out, std::string& error) {
+    app::profile::Scope scope("dxf_read");
+    out = Outline{};
+    io::MappedFile file(path);
+    if(!file) {
+        error = std::string("cannot open ") + path;
+        return false;
+    }
+    static const char binary_sentinel[] = "AutoCAD Binary DXF";
+    if(file.size() >= sizeof(binary_sentinel) - 1
+        && std::memcmp(file.data(), binary_sentinel, sizeof(binary_sentinel) - 1) == 0) {
+        error = std::string(path) + ": binary DXF is not supported";
+        return false;
+    }
+
+    float tol = std::max(1e-4f, chord_tol_mm);
+    Builder build(tol);
+    Entity e, poly;
+    bool in_polyline = false;
+
+    auto wanted = [&](std::string_view l) { return layer.empty() || same_name(l, layer); };
+    auto emit = [&]() {
+        bool mirror = e.nz < 0.0;
+        if(e.type == "LWPOLYLINE") {
+            if(wanted(e.layer)) build.polyline(e.verts, e.flags & 1, mirror);
+        }
+        else if(e.type == "LINE") {
+            if(wanted(e.layer)) build.line(e.x[0], e.y[0], e.x[1], e.y[1]);
+        }
+        else if(e.type == "ARC") {
+            if(wanted(e.layer)) build.arc(e.x[0], e.y[0], e.r, e.a0, e.a1, false, mirror);
+        }
+        else if(e.type == "CIRCLE") {
+            if(wanted(e.layer)) build.arc(e.x[0], e.y[0], e.r, 0.0, 360.0, true, mirror);
+        }
+        else if(e.type == "POLYLINE") {
+            // 3D meshes and polyface meshes are not outlines
+            in_polyline = !(e.flags & (16 | 64));
+            poly.type = e.type;
+            poly.layer = e.layer;
+            poly.flags = e.flags;
+            poly.nz = e.nz;
+            poly.verts.clear();
+        }
+        else if(e.type == "VERTEX") {
+            if(in_polyline && !(e.flags & 16)) poly.verts.push_back({ e.x[0], e.y[0], e.bulge });
+        }
+        else if(e.type == "SEQEND") {
+            if(in_polyline && wanted(poly.layer)) build.polyline(poly.verts, poly.flags & 1, poly.nz < 0.0);
+            in_polyline = false;
+        }
+        };
+
+    Pairs in(file.data(), file.size());
+    int code;
+    std::string_view value;
+    bool in_entities = false, section_name = false, done = false;
+    auto number = [&](double& v) {
+        auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), v);
+        if(ec == std::errc() && end == value.data() + value.size()) return true;
+        error = std::string(path) + ":" + std::to_string(in.line_number()) + ": bad number '" + std::string(value) + "'";
+        return false;
+    };
+
+    while(!done && in.next(code, value)) {
+        if(!in_entities) {
+            // only the section headers matter outside ENTITIES
+            if(code == 0) section_name = value == "SECTION";
+            else if(code == 2 && section_name) {
+                in_entities = value == "ENTITIES";
+                section_name = false;
+                e.reset({});
+            }
+            continue;
+        }
+        if(code == 0) {
+            emit();
+            if(value == "ENDSEC") done = true;
+            e.reset(value);
+            continue;
+        }
+        double v;
+        bool lw = e.type == "LWPOLYLINE";
+        switch(code) {
+        case 8: e.layer = value; break;
+        case 10: if(!number(v)) return false; if(lw) e.verts.push_back({ v, 0.0, 0.0 }); else e.x[0] = v; break;
+        case 20: if(!number(v)) return false; if(lw) { if(!e.verts.empty()) e.verts.back().y = v; } else e.y[0] = v; break;
+        case 11: if(!number(v)) return false; e.x[1] = v; break;
+        case 21: if(!number(v)) return false; e.y[1] = v; break;
+        case 40: if(!number(v)) return false; e.r = v; break;
+        case 42: if(!number(v)) return false; if(lw) { if(!e.verts.empty()) e.verts.back().bulge = v; } else e.bulge = v; break;
+        case 50: if(!number(v)) return false; e.a0 = v; break;
+        case 51: if(!number(v)) return false; e.a1 = v; break;
+        case 70: if(!number(v)) return false; e.flags = int(v); break;
+        case 230: if(!number(v)) return false; e.nz = v; break;
+        default: break;
+        }
+    }
+    if(in_entities && !done) emit();
+
+    out.open = chain(build.pieces, double(tol), build.closed);
+
+    const geometry::RingSet& rings = build.closed;
+    if(rings.empty()) {
+        error = std::string(path) + ": no closed contour" + (layer.empty() ? "" : " on layer " + std::string(layer));
+        return false;
+    }
+
+    // largest contour first; keep-outs are the contours inside it that are
+    // not inside a larger keep-out
+    std::vector<double> areas(rings.size());
+    for(size_t i = 0; i < rings.size(); ++i) areas[i] = std::fabs(area(rings[i]));
+    std::vector<size_t> order(rings.size());
+    std::iota(order.begin(), order.end(), size_t(0));
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return areas[a] > areas[b]; });
+
+    out.rings.add_ring(rings[order[0]]);
+    geometry::EdgeGrid outline(out.rings, 0.0f);
+
+    // kept keep-outs are bucketed by bounding box on a grid over the outline
+    float x0 = INFINITY, y0 = INFINITY, x1 = -INFINITY, y1 = -INFINITY;
+    for(const Vec2& v : out.rings[0]) {
+        x0 = std::min(x0, v.x); y0 = std::min(y0, v.y);
+        x1 = std::max(x1, v.x); y1 = std::max(y1, v.y);
+    }
+    int side = std::clamp(int(std::sqrt(double(rings.size()))), 1, 1024);
+    float cw = std::max(x1 - x0, 1e-6f) / float(side), ch = std::max(y1 - y0, 1e-6f) / float(side);
+    auto cell_x = [&](float x) { return std::clamp(int((x - x0) / cw), 0, side - 1); };
+    auto cell_y = [&](float y) { return std::clamp(int((y - y0) / ch), 0, side - 1); };
+    std::vector<std::vector<uint32_t>> buckets(size_t(side) * size_t(side));
+
+    for(size_t k = 1; k < order.size(); ++k) {
+        auto r = rings[order[k]];
+        Vec2 p = r[0];
+        bool keep = outline.inside(p);
+        if(keep) {
+            for(uint32_t j : buckets[size_t(cell_y(p.y)) * size_t(side) + size_t(cell_x(p.x))])
+                if(!(keep = !inside(out.rings[j], p))) break;
+        }
+        if(!keep) { ++out.outside; continue; }
+
+        uint32_t ring = uint32_t(out.rings.size());
+        out.rings.add_ring(r);
+        float bx0 = INFINITY, by0 = INFINITY, bx1 = -INFINITY, by1 = -INFINITY;
+        for(const Vec2& v : r) {
+            bx0 = std::min(bx0, v.x); by0 = std::min(by0, v.y);
+            bx1 = std::max(bx1, v.x); by1 = std::max(by1, v.y);
+        }
+        for(int y = cell_y(by0); y <= cell_y(by1); ++y)
+            for(int x = cell_x(bx0); x <= cell_x(bx1); ++x)
+                buckets[size_t(y) * size_t(side) + size_t(x)].push_back(ring);
+    }
+    return true;
+}
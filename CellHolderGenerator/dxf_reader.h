@@ -0,0 +1,24 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include "ring_set.h"
+
+namespace dxf {
+    // Plate outline taken from a drawing.
+    struct Outline {
+        geometry::RingSet rings; // ring 0 the outline, then the keep-outs inside it
+        size_t open = 0;         // contours that did not close, ignored
+        size_t outside = 0;      // closed contours outside the outline or inside a keep-out, ignored
+    };
+
+    // Reads the ENTITIES section of an ASCII DXF in one pass over the mapped
+    // file. Closed LWPOLYLINE and POLYLINE loops and CIRCLEs become rings
+    // directly; LINEs, ARCs and open polylines are chained end to end where
+    // their endpoints lie within chord_tol_mm. Arcs and bulges are
+    // tessellated to chord_tol_mm like the cell holes. The largest closed
+    // contour is the outline and the contours inside it are keep-outs. Only
+    // entities on layer are read unless it is empty; blocks are not expanded.
+    bool read_outline(const char* path, float chord_tol_mm, std::string_view layer,
+        Outline& out, std::string& error);
+}
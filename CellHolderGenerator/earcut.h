@@ -106,8 +106,14 @@ namespace mapbox {
                 template <typename... Args>
                 T* construct(Args&&... args) {
                     if(currentIndex >= blockSize) {
-                        currentBlock = alloc_traits::allocate(alloc, blockSize);
-                        allocations.emplace_back(currentBlock);
+                        if(nextBlock < allocations.size()) {
+                            currentBlock = allocations[nextBlock];
+                        }
+                        else {
+                            currentBlock = alloc_traits::allocate(alloc, blockSize);
+                            allocations.emplace_back(currentBlock);
+                        }
+                        ++nextBlock;
                         currentIndex = 0;
                     }
                     T* object = &currentBlock[currentIndex++];
@@ -122,17 +128,28 @@ namespace mapbox {
                     blockSize = std::max<std::size_t>(1, newBlockSize);
                     currentBlock = nullptr;
                     currentIndex = blockSize;
+                    nextBlock = 0;
                 }
                 void clear() { reset(blockSize); }
+                // start handing out already allocated blocks again; only grows the
+                // block size when a larger one is requested
+                void recycle(std::size_t newBlockSize) {
+                    if(newBlockSize > blockSize) { reset(newBlockSize); return; }
+                    currentBlock = nullptr;
+                    currentIndex = blockSize;
+                    nextBlock = 0;
+                }
             private:
                 T* currentBlock = nullptr;
                 std::size_t currentIndex = 1;
                 std::size_t blockSize = 1;
+                std::size_t nextBlock = 0;
                 std::vector<T*> allocations;
                 Alloc alloc;
                 typedef typename std::allocator_traits<Alloc> alloc_traits;
             };
             ObjectPool<Node> nodes;
+            std::vector<Node*> holeQueue;
         };
 
         template <typename N> template <typename Polygon>
@@ -153,8 +170,8 @@ namespace mapbox {
                 len += points[i].size();
             }
 
-            //estimate size of nodes and indices
-            nodes.reset(len * 3 / 2);
+            //estimate size of nodes and indices; node blocks from earlier calls are reused
+            nodes.recycle(len * 3 / 2);
             indices.reserve(len + points[0].size());
 
             Node* outerNode = linkedList(points[0], true);
@@ -184,8 +201,6 @@ namespace mapbox {
             }
 
             earcutLinked(outerNode);
-
-            nodes.clear();
         }
 
         // create a circular doubly linked list from polygon points in the specified winding order
@@ -429,7 +444,8 @@ namespace mapbox {
             Earcut<N>::eliminateHoles(const Polygon& points, Node* outerNode) {
             const size_t len = points.size();
 
-            std::vector<Node*> queue;
+            std::vector<Node*>& queue = holeQueue;
+            queue.clear();
             for(size_t i = 1; i < len; i++) {
                 Node* list = linkedList(points[i], false);
                 if(list) {
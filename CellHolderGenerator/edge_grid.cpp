@@ -0,0 +1,105 @@
+#include "edge_grid.h"
+#include <algorithm>
+#include <cmath>
+
+using geometry::EdgeGrid;
+
+void EdgeGrid::build(const RingSet& rings, float cell_size) {
+    std::vector<std::span<const Vec2>> spans;
+    spans.reserve(rings.size());
+    for(size_t i = 0; i < rings.size(); ++i) spans.push_back(rings[i]);
+    build(spans, cell_size);
+}
+
+void EdgeGrid::build(std::span<const std::span<const Vec2>> rings, float cell_size) {
+    edges.clear();
+    lo_x = lo_y = INFINITY;
+    hi_x = hi_y = -INFINITY;
+    for(const auto& ring : rings) {
+        // edges run from ring[i] to ring[i - 1], as in the usual crossing loop
+        for(size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++) {
+            edges.push_back({ ring[i], ring[j] });
+            lo_x = std::min(lo_x, ring[i].x); hi_x = std::max(hi_x, ring[i].x);
+            lo_y = std::min(lo_y, ring[i].y); hi_y = std::max(hi_y, ring[i].y);
+        }
+    }
+    first.assign(1, 0);
+    ids.clear();
+    nx = ny = 0;
+    if(edges.empty()) return;
+
+    double w = double(hi_x) - lo_x, h = double(hi_y) - lo_y;
+    double cs = std::max(double(cell_size), 1e-6 * std::max({ w, h, 1.0 }));
+    double limit = 4.0 * double(edges.size()) + 64.0;
+    double cells = (std::floor(w / cs) + 1.0) * (std::floor(h / cs) + 1.0);
+    if(cells > limit) cs *= std::sqrt(cells / limit) * 1.01;
+    inv_cell = float(1.0 / cs);
+    nx = int(std::floor(w / cs)) + 1;
+    ny = int(std::floor(h / cs)) + 1;
+
+    // counting pass, prefix sums, then fill
+    size_t n = size_t(nx) * size_t(ny);
+    first.assign(n + 1, 0);
+    auto span_of = [&](const Edge& e, int& x0, int& x1, int& y0, int& y1) {
+        x0 = col(std::min(e.a.x, e.b.x)); x1 = col(std::max(e.a.x, e.b.x));
+        y0 = row(std::min(e.a.y, e.b.y)); y1 = row(std::max(e.a.y, e.b.y));
+    };
+    for(const Edge& e : edges) {
+        int x0, x1, y0, y1;
+        span_of(e, x0, x1, y0, y1);
+        for(int y = y0; y <= y1; ++y)
+            for(int x = x0; x <= x1; ++x) ++first[size_t(y) * size_t(nx) + size_t(x) + 1];
+    }
+    for(size_t c = 0; c < n; ++c) first[c + 1] += first[c];
+    ids.resize(first[n]);
+    std::vector<uint32_t> at(first.begin(), first.end() - 1);
+    for(uint32_t k = 0; k < uint32_t(edges.size()); ++k) {
+        int x0, x1, y0, y1;
+        span_of(edges[k], x0, x1, y0, y1);
+        for(int y = y0; y <= y1; ++y)
+            for(int x = x0; x <= x1; ++x) ids[at[size_t(y) * size_t(nx) + size_t(x)]++] = k;
+    }
+}
+
+int EdgeGrid::col(float x) const {
+    return std::clamp(int(std::floor((x - lo_x) * inv_cell)), 0, nx - 1);
+}
+
+int EdgeGrid::row(float y) const {
+    return std::clamp(int(std::floor((y - lo_y) * inv_cell)), 0, ny - 1);
+}
+
+bool EdgeGrid::inside(Vec2 p) const {
+    if(edges.empty() || p.y < lo_y || p.y > hi_y || p.x < lo_x || p.x > hi_x) return false;
+    // walk the grid row from p to the nearer end; a crossing is counted only
+    // in the grid cell that holds its x, so edges listed in several cells
+    // count once
+    bool in = false;
+    int y = row(p.y), from = col(p.x);
+    bool right = from >= nx / 2;
+    for(int x = from; x >= 0 && x < nx; x += right ? 1 : -1) {
+        size_t c = size_t(y) * size_t(nx) + size_t(x);
+        for(uint32_t k = first[c]; k < first[c + 1]; ++k) {
+            const Vec2& a = edges[ids[k]].a;
+            const Vec2& b = edges[ids[k]].b;
+            if((a.y > p.y) == (b.y > p.y)) continue;
+            double cx = double(a.x) + (double(p.y) - a.y) * (double(b.x) - a.x) / (double(b.y) - a.y);
+            if(right ? double(p.x) >= cx : double(p.x) < cx) continue;
+            cx = std::clamp(cx, double(std::min(a.x, b.x)), double(std::max(a.x, b.x)));
+            if(col(float(cx)) == x) in = !in;
+        }
+    }
+    return in;
+}
+
+bool EdgeGrid::within(Vec2 p, float d) const {
+    double dd = double(d) * double(d);
+    return any({ p.x - d, p.y - d }, { p.x + d, p.y + d }, [&](const Edge& e) {
+        double ex = double(e.b.x) - e.a.x, ey = double(e.b.y) - e.a.y;
+        double px = double(p.x) - e.a.x, py = double(p.y) - e.a.y;
+        double len = ex * ex + ey * ey;
+        double t = len > 0.0 ? std::clamp((px * ex + py * ey) / len, 0.0, 1.0) : 0.0;
+        double dx = px - t * ex, dy = py - t * ey;
+        return dx * dx + dy * dy < dd;
+    });
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "ring_set.h"
+#include "vec2.h"
+
+namespace geometry {
+    // Uniform-grid index over the edges of a set of rings, so clearance and
+    // inside tests against outlines with many thousands of edges only look at
+    // the edges near the query. Every edge is listed in each grid cell its
+    // bounding box touches.
+    class EdgeGrid {
+    public:
+        struct Edge { Vec2 a, b; };
+
+        EdgeGrid() = default;
+        explicit EdgeGrid(const RingSet& rings, float cell_size) { build(rings, cell_size); }
+
+        // Indexes every edge of the given rings with grid cells of about
+        // cell_size; the grid is coarsened when the bounds would need far
+        // more cells than there are edges, so 0 sizes it by edge count alone.
+        void build(std::span<const std::span<const Vec2>> rings, float cell_size);
+        void build(const RingSet& rings, float cell_size);
+
+        // Calls f(edge) for the edges listed in the grid cells overlapping
+        // [lo, hi] until f returns true, and returns whether it did. An edge
+        // can be seen more than once.
+        template <typename F>
+        bool any(Vec2 lo, Vec2 hi, F&& f) const {
+            if(edges.empty() || hi.x < lo_x || hi.y < lo_y || lo.x > hi_x || lo.y > hi_y) return false;
+            int x0 = col(lo.x), x1 = col(hi.x), y0 = row(lo.y), y1 = row(hi.y);
+            for(int y = y0; y <= y1; ++y)
+                for(int x = x0; x <= x1; ++x) {
+                    size_t c = size_t(y) * size_t(nx) + size_t(x);
+                    for(uint32_t k = first[c]; k < first[c + 1]; ++k)
+                        if(f(edges[ids[k]])) return true;
+                }
+            return false;
+        }
+
+        // Even-odd inside test against all indexed rings.
+        bool inside(Vec2 p) const;
+
+        // True if some edge passes closer than d to p.
+        bool within(Vec2 p, float d) const;
+
+        size_t size() const { return edges.size(); }
+
+        // Position of e in build order. For a RingSet this is the index in
+        // pts of e.a, so the ring an edge belongs to can be looked up.
+        uint32_t index(const Edge& e) const { return uint32_t(&e - edges.data()); }
+
+    private:
+        int col(float x) const;
+        int row(float y) const;
+
+        std::vector<Edge> edges;
+        std::vector<uint32_t> first;
+        std::vector<uint32_t> ids;
+        float lo_x = 0, lo_y = 0, hi_x = 0, hi_y = 0;
+        float inv_cell = 1;
+        int nx = 0, ny = 0;
+    };
+}
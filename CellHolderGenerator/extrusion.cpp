@@ -0,0 +1,98 @@
+#include "extrusion.h"
+#include "profiler.h"
+#include "thread_pool.h"
+#include <algorithm>
+
+using geometry::Section;
+using geometry::Triangle;
+
+size_t geometry::extruded_triangle_count(const Section& s) {
+    return 2 * (s.I.size() / 3) + 2 * s.rings.pts.size();
+}
+
+namespace {
+    // Writes faces [first, last) of the extruded prism in mesh numbering
+    // (bottom vertices [0, N), top vertices [N, 2N)): both caps per cap
+    // triangle, then two wall faces per ring edge. Any range can be produced
+    // on its own, which is what makes the parallel paths deterministic.
+    void faces_range(const Section& s, size_t first, size_t last, Face* out) {
+        const int N = int(s.rings.pts.size() + s.extra.size());
+        const size_t capFaces = 2 * (s.I.size() / 3);
+        const auto& offs = s.rings.offsets;
+
+        size_t t = first;
+        for(; t < last && t < capFaces; ++t) {
+            size_t k = 3 * (t / 2);
+            if(t % 2 == 0) *out++ = { int(s.I[k + 2]), int(s.I[k + 1]), int(s.I[k]) };
+            else           *out++ = { int(s.I[k]) + N, int(s.I[k + 1]) + N, int(s.I[k + 2]) + N };
+        }
+        if(t == last) return;
+
+        size_t j = (t - capFaces) / 2;
+        size_t r = size_t(std::upper_bound(offs.begin(), offs.end(), uint32_t(j)) - offs.begin()) - 1;
+        for(; t < last; ++t) {
+            j = (t - capFaces) / 2;
+            while(j >= offs[r + 1]) ++r;
+            int i0 = int(j);
+            int i1 = int(j + 1 == offs[r + 1] ? offs[r] : j + 1);
+            if(t % 2 == 0) *out++ = { i0, i1, i1 + N };
+            else           *out++ = { i0, i1 + N, i0 + N };
+        }
+    }
+}
+
+void geometry::extrude(const Section& s, float height, TriangleSink& sink, size_t batch) {
+    const std::vector<Vec2>& V = s.rings.pts;
+    const size_t N = V.size() + s.extra.size();
+    auto at = [&](int i) -> Vec3 {
+        size_t v = size_t(i) % N;
+        const Vec2& p = v < V.size() ? V[v] : s.extra[v - V.size()];
+        return { p.x, p.y, size_t(i) >= N ? height : 0.f };
+        };
+
+    // a window of batches is built in parallel, then handed to the sink in order
+    auto& pool = app::ThreadPool::shared();
+    batch = std::max<size_t>(1, batch);
+    const size_t window = 2 * pool.size();
+    const size_t total = extruded_triangle_count(s);
+    std::vector<std::vector<Triangle>> bufs(window);
+    std::vector<std::vector<Face>> faces(window);
+
+    for(size_t base = 0; base < total; base += window * batch) {
+        size_t blocks = std::min(window, (total - base + batch - 1) / batch);
+        pool.parallel_for(blocks, [&](size_t b) {
+            size_t first = base + b * batch, last = std::min(total, first + batch);
+            faces[b].resize(last - first);
+            faces_range(s, first, last, faces[b].data());
+            bufs[b].resize(last - first);
+            for(size_t i = 0; i < faces[b].size(); ++i) {
+                const Face& f = faces[b][i];
+                bufs[b][i] = { at(f.v1), at(f.v2), at(f.v3) };
+            }
+            });
+        for(size_t b = 0; b < blocks; ++b)
+            sink.consume(bufs[b].data(), bufs[b].size());
+    }
+}
+
+Mesh geometry::extrude_mesh(const Section& s, float height) {
+    app::profile::Scope scope("extrude_mesh");
+    Mesh m;
+    const std::vector<Vec2>& V = s.rings.pts;
+    m.vertices.reserve((V.size() + s.extra.size()) * 2);
+    for(float z : { 0.f, height }) {
+        for(auto& v : V) m.vertices.push_back({ v.x, v.y, z });
+        for(auto& v : s.extra) m.vertices.push_back({ v.x, v.y, z });
+    }
+
+    size_t total = extruded_triangle_count(s);
+    m.faces.resize(total);
+
+    auto& pool = app::ThreadPool::shared();
+    const size_t block = 1 << 14;
+    pool.parallel_for((total + block - 1) / block, [&](size_t b) {
+        size_t first = b * block, last = std::min(total, first + block);
+        faces_range(s, first, last, m.faces.data() + first);
+        });
+    return m;
+}
\ No newline at end of file
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <span>
+#include "mesh.h"
+#include "ring_set.h"
+#include "vec2.h"
+#include "vec3.h"
+
+namespace geometry {
+    struct Triangle { Vec3 a, b, c; };
+
+    // Receives extruded triangles in bounded batches.
+    class TriangleSink {
+    public:
+        virtual ~TriangleSink() = default;
+        virtual void consume(const Triangle* tris, size_t n) = 0;
+    };
+
+    // Cross-section of the prism: rings and cap triangle indices. Cap indices
+    // past rings.pts address extra (cap-only vertices that have no side wall).
+    struct Section {
+        const RingSet& rings;
+        const std::vector<uint32_t>& I;
+        const std::vector<Vec2>& extra;
+    };
+
+    // Two triangles per cap triangle plus two per ring edge.
+    size_t extruded_triangle_count(const Section& s);
+
+    // Streams the prism straight into sink: bottom/top caps from the
+    // triangulation, then the side walls ring by ring. Batches are built in
+    // parallel a window at a time and delivered in order, so the sink sees the
+    // same sequence for any thread count; memory is bounded by the window.
+    void extrude(const Section& s, float height, TriangleSink& sink, size_t batch = 4096);
+
+    // Same prism as an indexed mesh (bottom pts + extra, then top pts + extra).
+    Mesh extrude_mesh(const Section& s, float height);
+}
\ No newline at end of file
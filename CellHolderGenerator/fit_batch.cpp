@@ -0,0 +1,153 @@
+#include "cell_layout.h"
+#include "thread_pool.h"
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define FIT_BATCH_AVX2 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define AVX2_TARGET
+#else
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+using app::CellLayout;
+using FitBatch = CellLayout::FitBatch;
+
+void FitBatch::reserve(size_t n) {
+    width.reserve(n); height.reserve(n); cell_dia.reserve(n);
+    spacing.reserve(n); wall_thickness.reserve(n);
+    series.reserve(n); parallel.reserve(n); honeycomb.reserve(n);
+}
+
+void FitBatch::push(float w, float h, float d, float s, float t, int ns, int np, bool honey) {
+    width.push_back(w); height.push_back(h); cell_dia.push_back(d);
+    spacing.push_back(s); wall_thickness.push_back(t);
+    series.push_back(ns); parallel.push_back(np); honeycomb.push_back(honey ? 1 : 0);
+}
+
+static void fit_scalar(FitBatch& b, size_t begin, size_t end) {
+    for(size_t i = begin; i < end; ++i) {
+        auto r = CellLayout::fitRect(b.width[i], b.height[i], b.cell_dia[i], b.spacing[i],
+            b.wall_thickness[i], b.series[i], b.parallel[i], b.honeycomb[i] != 0);
+        b.fits[i] = r.fits ? 1 : 0;
+        b.maxSeries[i] = r.maxSeries;
+        b.maxParallel[i] = r.maxParallel;
+        b.reqWidth[i] = r.reqWidth;
+        b.reqHeight[i] = r.reqHeight;
+        b.deltaWidth[i] = r.deltaWidth;
+        b.deltaHeight[i] = r.deltaHeight;
+    }
+}
+
+#ifdef FIT_BATCH_AVX2
+static bool has_avx2() {
+#ifdef _MSC_VER
+    int r[4];
+    __cpuid(r, 0);
+    if(r[0] < 7) return false;
+    __cpuid(r, 1);
+    bool osxsave = (r[2] & (1 << 27)) != 0, avx = (r[2] & (1 << 28)) != 0;
+    if(!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;
+    __cpuidex(r, 7, 0);
+    return (r[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+// Same operations in the same order as fitRect, so every lane rounds exactly
+// like the scalar code. The square/honeycomb branches become blends: a square
+// lattice has off == 0 and x - 0 is exact. The min/max pair is
+// lattice_count's clamp, which agrees with std::clamp for finite quotients.
+AVX2_TARGET static void fit_avx2(FitBatch& b, size_t begin, size_t end) {
+    const __m256 zero = _mm256_setzero_ps(), two = _mm256_set1_ps(2.0f), half = _mm256_set1_ps(0.5f);
+    const __m256 honey_step = _mm256_set1_ps(0.8660254037844386f);
+    const __m256 qmin = _mm256_set1_ps(-1.f), qmax = _mm256_set1_ps(1e9f);
+    const __m256i izero = _mm256_setzero_si256(), ione = _mm256_set1_epi32(1);
+
+    size_t i = begin;
+    for(; i + 8 <= end; i += 8) {
+        __m256 W = _mm256_loadu_ps(&b.width[i]);
+        __m256 H = _mm256_loadu_ps(&b.height[i]);
+        __m256 D = _mm256_loadu_ps(&b.cell_dia[i]);
+        __m256 S = _mm256_loadu_ps(&b.spacing[i]);
+        __m256 t = _mm256_loadu_ps(&b.wall_thickness[i]);
+        __m256i ns = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&b.series[i]));
+        __m256i np = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&b.parallel[i]));
+        __m256i hb = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&b.honeycomb[i])));
+        __m256 honey = _mm256_castsi256_ps(_mm256_cmpgt_epi32(hb, izero));
+
+        __m256 pitch = _mm256_add_ps(D, S);
+        __m256 off = _mm256_blendv_ps(zero, _mm256_mul_ps(half, pitch), honey);
+        __m256 vstep = _mm256_blendv_ps(pitch, _mm256_mul_ps(pitch, honey_step), honey);
+
+        __m256 t2 = _mm256_mul_ps(two, t);
+        __m256 edge = _mm256_mul_ps(two, _mm256_add_ps(S, _mm256_mul_ps(half, D)));
+        __m256 base = _mm256_add_ps(t2, edge);
+
+        __m256 spanW = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(ns, ione)), pitch);
+        __m256 spanH = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(np, ione)), vstep);
+        spanW = _mm256_blendv_ps(zero, spanW, _mm256_castsi256_ps(_mm256_cmpgt_epi32(ns, izero)));
+        spanH = _mm256_blendv_ps(zero, spanH, _mm256_castsi256_ps(_mm256_cmpgt_epi32(np, izero)));
+        __m256 reqW = _mm256_add_ps(_mm256_add_ps(base, spanW), off);
+        __m256 reqH = _mm256_add_ps(base, spanH);
+
+        __m256 ok = _mm256_and_ps(_mm256_cmp_ps(reqW, W, _CMP_LE_OQ), _mm256_cmp_ps(reqH, H, _CMP_LE_OQ));
+        __m256i iok = _mm256_castps_si256(ok);
+
+        __m256 freeW = _mm256_sub_ps(_mm256_sub_ps(_mm256_sub_ps(W, t2), edge), off);
+        __m256 freeH = _mm256_sub_ps(_mm256_sub_ps(H, t2), edge);
+        __m256 qW = _mm256_max_ps(_mm256_min_ps(_mm256_div_ps(freeW, pitch), qmax), qmin);
+        __m256 qH = _mm256_max_ps(_mm256_min_ps(_mm256_div_ps(freeH, vstep), qmax), qmin);
+        __m256i ms = _mm256_max_epi32(izero, _mm256_add_epi32(_mm256_cvttps_epi32(qW), ione));
+        __m256i mp = _mm256_max_epi32(izero, _mm256_add_epi32(_mm256_cvttps_epi32(qH), ione));
+        ms = _mm256_blendv_epi8(_mm256_min_epi32(ms, ns), ns, iok);
+        mp = _mm256_blendv_epi8(_mm256_min_epi32(mp, np), np, iok);
+
+        __m256 dW = _mm256_blendv_ps(_mm256_max_ps(_mm256_sub_ps(reqW, W), zero), zero, ok);
+        __m256 dH = _mm256_blendv_ps(_mm256_max_ps(_mm256_sub_ps(reqH, H), zero), zero, ok);
+
+        int mask = _mm256_movemask_ps(ok);
+        for(int k = 0; k < 8; ++k) b.fits[i + k] = uint8_t((mask >> k) & 1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&b.maxSeries[i]), ms);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&b.maxParallel[i]), mp);
+        _mm256_storeu_ps(&b.reqWidth[i], reqW);
+        _mm256_storeu_ps(&b.reqHeight[i], reqH);
+        _mm256_storeu_ps(&b.deltaWidth[i], dW);
+        _mm256_storeu_ps(&b.deltaHeight[i], dH);
+
+        // fitRect returns early for these; rare enough to redo one by one
+        __m256 bad = _mm256_or_ps(_mm256_cmp_ps(pitch, zero, _CMP_NGT_UQ),
+            _mm256_castsi256_ps(_mm256_or_si256(_mm256_cmpgt_epi32(ione, ns), _mm256_cmpgt_epi32(ione, np))));
+        for(int m = _mm256_movemask_ps(bad), k = 0; m; m >>= 1, ++k)
+            if(m & 1) fit_scalar(b, i + k, i + k + 1);
+    }
+    fit_scalar(b, i, end);
+}
+#endif
+
+void CellLayout::fitRectBatch(FitBatch& b) {
+    size_t n = b.size();
+    b.fits.resize(n);
+    b.maxSeries.resize(n);
+    b.maxParallel.resize(n);
+    b.reqWidth.resize(n);
+    b.reqHeight.resize(n);
+    b.deltaWidth.resize(n);
+    b.deltaHeight.resize(n);
+
+    void (*kernel)(FitBatch&, size_t, size_t) = fit_scalar;
+#ifdef FIT_BATCH_AVX2
+    static const bool avx2 = has_avx2();
+    if(avx2) kernel = fit_avx2;
+#endif
+
+    // blocks are a multiple of 8 so only the last one has a scalar tail
+    const size_t block = 16384;
+    ThreadPool::shared().parallel_for((n + block - 1) / block, [&](size_t k) {
+        kernel(b, k * block, std::min(n, (k + 1) * block));
+    });
+}
@@ -0,0 +1,357 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+#include "gcode_exporter.h"
+#include "edge_grid.h"
+#include "output_sink.h"
+#include "profiler.h"
+#include "text_format.h"
+#include "thread_pool.h"
+
+using geometry::RingSet;
+using Path = std::vector<Vec2>;
+
+namespace {
+    double signed_area(std::span<const Vec2> r) {
+        double a = 0.0;
+        for(size_t i = 0, j = r.size() - 1; i < r.size(); j = i++)
+            a += double(r[j].x) * r[i].y - double(r[i].x) * r[j].y;
+        return 0.5 * a;
+    }
+
+    float length(Vec2 v) { return std::hypot(v.x, v.y); }
+
+    Vec2 unit(Vec2 v) {
+        float l = length(v);
+        return l > 0.f ? Vec2{ v.x / l, v.y / l } : Vec2{ 0.f, 0.f };
+    }
+
+    double seg_dist(Vec2 p, Vec2 a, Vec2 b) {
+        double ex = double(b.x) - a.x, ey = double(b.y) - a.y;
+        double px = double(p.x) - a.x, py = double(p.y) - a.y;
+        double len = ex * ex + ey * ey;
+        double t = len > 0.0 ? std::clamp((px * ex + py * ey) / len, 0.0, 1.0) : 0.0;
+        return std::hypot(px - t * ex, py - t * ey);
+    }
+
+    // Perimeter k of a ring runs (k + 0.5) * w into the material, offset
+    // along the mitred vertex normals. Where another ring comes closer than
+    // the loops of both rings need, the ring with the lower index keeps its
+    // loops and the other drops them there, so a web one line wide between
+    // two holes gets one line instead of two on top of each other. Loops
+    // broken that way are written as open runs.
+    void perimeters(const RingSet& rings, const geometry::EdgeGrid& grid,
+        const GCodeExporter::Settings& s, std::vector<Path>& out) {
+        const int P = std::max(0, s.perimeters);
+        const float w = s.extrusion_width;
+        if(P == 0) return;
+        std::vector<std::vector<Path>> per_ring(rings.size());
+        auto& pool = app::ThreadPool::shared();
+        pool.parallel_for(rings.size(), [&](size_t r) {
+            // repeated points would give edges without a direction
+            std::vector<Vec2> ring;
+            for(const Vec2& v : rings[r])
+                if(ring.empty() || v.x != ring.back().x || v.y != ring.back().y) ring.push_back(v);
+            while(ring.size() > 1 && ring.back().x == ring[0].x && ring.back().y == ring[0].y) ring.pop_back();
+            size_t n = ring.size();
+            if(n < 3) return;
+            // material lies left of the outline when it runs counter-clockwise
+            // and left of a hole when it runs clockwise
+            double area = signed_area(ring);
+            float side = (r == 0) == (area > 0.0) ? 1.f : -1.f;
+            uint32_t own0 = rings.start(r), own1 = own0 + rings.count(r);
+
+            std::vector<Vec2> corners(n), q;
+            std::vector<char> corner, keep;
+            for(int k = 0; k < P; ++k) {
+                float o = (float(k) + 0.5f) * w;
+                float reach = o + (float(P) + 0.5f) * w;
+                for(size_t i = 0; i < n; ++i) {
+                    Vec2 a = ring[(i + n - 1) % n], v = ring[i], b = ring[(i + 1) % n];
+                    Vec2 d1 = unit(v - a), d2 = unit(b - v);
+                    Vec2 n1{ -d1.y * side, d1.x * side }, n2{ -d2.y * side, d2.x * side };
+                    Vec2 m = unit(n1 + n2);
+                    float c = std::max(0.25f, m.x * n1.x + m.y * n1.y);
+                    corners[i] = { v.x + m.x * (o / c), v.y + m.y * (o / c) };
+                }
+                // long edges are tested every half line width, so a hole
+                // passing the middle of an edge still breaks the loop
+                q.clear();
+                corner.clear();
+                for(size_t i = 0; i < n; ++i) {
+                    Vec2 a = corners[i], d = corners[(i + 1) % n] - a;
+                    int pieces = std::max(1, int(length(d) / (0.5f * w)));
+                    for(int t = 0; t < pieces; ++t) {
+                        float f = float(t) / float(pieces);
+                        q.push_back({ a.x + d.x * f, a.y + d.y * f });
+                        corner.push_back(t == 0);
+                    }
+                }
+                size_t m = q.size();
+                keep.assign(m, 0);
+                for(size_t i = 0; i < m; ++i) {
+                    double near = INFINITY;
+                    size_t near_ring = r;
+                    grid.any({ q[i].x - reach, q[i].y - reach }, { q[i].x + reach, q[i].y + reach },
+                        [&](const geometry::EdgeGrid::Edge& e) {
+                            uint32_t at = grid.index(e);
+                            if(at >= own0 && at < own1) return false;
+                            double d = seg_dist(q[i], e.a, e.b);
+                            if(d < near) {
+                                near = d;
+                                near_ring = size_t(std::upper_bound(rings.offsets.begin(), rings.offsets.end(), at)
+                                    - rings.offsets.begin()) - 1;
+                            }
+                            return false;
+                        });
+                    // width of material across this point, and the loops it needs
+                    double across = double(o) + near, eps = 0.01 * w;
+                    double need = double(k + 1) * w;
+                    if(near_ring < r) need += std::min(double(P), std::floor((across + eps) / w)) * w;
+                    keep[i] = (near > reach || need <= across + eps) && grid.inside(q[i]);
+                }
+
+                // test points in the middle of a kept stretch are dropped again
+                auto& paths = per_ring[r];
+                size_t gap = std::find(keep.begin(), keep.end(), 0) - keep.begin();
+                if(gap == m) {
+                    Path loop;
+                    for(size_t i = 0; i < m; ++i)
+                        if(corner[i]) loop.push_back(q[i]);
+                    loop.push_back(q[0]);
+                    paths.push_back(std::move(loop));
+                    continue;
+                }
+                Path run;
+                for(size_t t = 1; t <= m; ++t) {
+                    size_t i = (gap + t) % m;
+                    bool last = !keep[(i + 1) % m];
+                    if(keep[i] && (corner[i] || run.empty() || last)) run.push_back(q[i]);
+                    if(!keep[i] && !run.empty()) {
+                        if(run.size() >= 2) paths.push_back(std::move(run));
+                        run.clear();
+                    }
+                }
+            }
+        }, pool.grain(rings.size()));
+        for(auto& paths : per_ring)
+            for(auto& p : paths) out.push_back(std::move(p));
+    }
+
+    // x-interval of the line y = v within distance rho of segment ab, which
+    // is convex: the hull of the line's cuts through both end circles and
+    // through the band swept along the segment. False if the line misses.
+    bool capsule_cut(Vec2 a, Vec2 b, float v, float rho, float& l, float& r) {
+        double lo = INFINITY, hi = -INFINITY;
+        for(Vec2 p : { a, b }) {
+            double dy = double(v) - p.y;
+            if(std::abs(dy) > rho) continue;
+            double h = std::sqrt(double(rho) * rho - dy * dy);
+            lo = std::min(lo, p.x - h);
+            hi = std::max(hi, p.x + h);
+        }
+        double dx = double(b.x) - a.x, dy = double(b.y) - a.y, len = std::hypot(dx, dy);
+        if(len > 0.0) {
+            // along = ((x - a.x) dx + (v - a.y) dy) / len in [0, len] and
+            // side = ((v - a.y) dx - (x - a.x) dy) / len in [-rho, rho]
+            double x0 = -INFINITY, x1 = INFINITY;
+            auto clip = [&](double c, double c0, double min, double max) {
+                if(std::abs(c) < 1e-12) {
+                    if(c0 < min || c0 > max) x1 = -INFINITY;
+                    return;
+                }
+                double e0 = (min - c0) / c, e1 = (max - c0) / c;
+                x0 = std::max(x0, std::min(e0, e1));
+                x1 = std::min(x1, std::max(e0, e1));
+            };
+            double ry = double(v) - a.y;
+            clip(dx / len, (-double(a.x) * dx + ry * dy) / len, 0.0, len);
+            clip(-dy / len, (ry * dx + double(a.x) * dy) / len, -double(rho), double(rho));
+            if(x0 <= x1) {
+                lo = std::min(lo, x0);
+                hi = std::max(hi, x1);
+            }
+        }
+        if(lo > hi) return false;
+        l = float(lo);
+        r = float(hi);
+        return true;
+    }
+
+    // Scanlines across the whole cross-section. The inside spans of each
+    // line lose every stretch closer to a boundary edge than the perimeters
+    // reach plus half a line, so infill meets the innermost perimeter
+    // without overlapping it, whatever the angle of the edge. Spans shorter
+    // than a line width are left out, and consecutive scanlines run in
+    // opposite directions.
+    void infill(const RingSet& rings, const GCodeExporter::Settings& s, bool vertical, std::vector<Path>& out) {
+        const float w = s.extrusion_width;
+        float density = std::clamp(s.infill_density, 0.f, 1.f);
+        if(density <= 0.f || rings.empty()) return;
+        auto uv = [&](Vec2 p) { return vertical ? Vec2{ p.y, p.x } : p; };
+        float lo = INFINITY, hi = -INFINITY;
+        for(const Vec2& p : rings.pts) {
+            lo = std::min(lo, uv(p).y);
+            hi = std::max(hi, uv(p).y);
+        }
+        float pitch = w / density;
+        assert(pitch > 0.f);
+        size_t lines = size_t(std::max(0.f, std::floor((hi - lo) / pitch)));
+        if(lines == 0) return;
+        auto line_v = [&](size_t k) { return lo + (float(k) + 0.5f) * pitch; };
+        float inset = (float(std::max(0, s.perimeters)) + 0.5f) * w;
+
+        // crossings and blocked stretches bucketed by scanline: count, prefix
+        // sums, fill
+        struct Cut { float l, r; };
+        std::vector<uint32_t> first_x(lines + 1, 0), first_cut(lines + 1, 0);
+        std::vector<float> xs;
+        std::vector<Cut> cuts;
+        for(int pass = 0; pass < 2; ++pass) {
+            std::vector<uint32_t> at_x(first_x.begin(), first_x.end() - 1);
+            std::vector<uint32_t> at_cut(first_cut.begin(), first_cut.end() - 1);
+            for(size_t r = 0; r < rings.size(); ++r) {
+                auto ring = rings[r];
+                for(size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++) {
+                    Vec2 a = uv(ring[i]), b = uv(ring[j]);
+                    float v0 = std::min(a.y, b.y) - inset, v1 = std::max(a.y, b.y) + inset;
+                    size_t k = size_t(std::max(0.f, std::floor((v0 - lo) / pitch - 0.5f)));
+                    for(; k < lines && line_v(k) <= v1; ++k) {
+                        float v = line_v(k);
+                        if((a.y > v) != (b.y > v)) {
+                            if(pass == 0) ++first_x[k + 1];
+                            else xs[at_x[k]++] = a.x + (v - a.y) * (b.x - a.x) / (b.y - a.y);
+                        }
+                        Cut c;
+                        if(!capsule_cut(a, b, v, inset - 0.01f * w, c.l, c.r)) continue;
+                        if(pass == 0) ++first_cut[k + 1];
+                        else cuts[at_cut[k]++] = c;
+                    }
+                }
+            }
+            if(pass == 0) {
+                for(size_t k = 0; k < lines; ++k) {
+                    first_x[k + 1] += first_x[k];
+                    first_cut[k + 1] += first_cut[k];
+                }
+                xs.resize(first_x[lines]);
+                cuts.resize(first_cut[lines]);
+            }
+        }
+
+        std::vector<std::vector<Path>> per_line(lines);
+        auto& pool = app::ThreadPool::shared();
+        pool.parallel_for(lines, [&](size_t k) {
+            auto xb = xs.begin() + first_x[k], xe = xs.begin() + first_x[k + 1];
+            auto cb = cuts.begin() + first_cut[k], ce = cuts.begin() + first_cut[k + 1];
+            std::sort(xb, xe);
+            std::sort(cb, ce, [](const Cut& l, const Cut& r) { return l.l < r.l; });
+            float v = line_v(k);
+            auto& spans = per_line[k];
+            auto emit = [&](float x0, float x1) {
+                if(x1 - x0 < w) return;
+                if(k % 2) std::swap(x0, x1);
+                spans.push_back({ uv({ x0, v }), uv({ x1, v }) });
+            };
+            auto c = cb;
+            for(auto x = xb; x + 1 < xe; x += 2) {
+                // cuts are sorted by their left end; walk them across the span
+                float from = x[0];
+                while(c != ce && c->r <= from) ++c;
+                for(auto d = c; d != ce && d->l < x[1]; ++d) {
+                    emit(from, d->l);
+                    from = std::max(from, d->r);
+                }
+                emit(from, x[1]);
+            }
+            if(k % 2) std::reverse(spans.begin(), spans.end());
+        }, pool.grain(lines));
+        for(auto& spans : per_line)
+            for(auto& p : spans) out.push_back(std::move(p));
+    }
+
+    // Formats the moves of one layer. The body starts with a travel from
+    // wherever the previous layer ended and leaves the filament primed.
+    void write_body(text::Buffer& b, const std::vector<Path>& paths, const GCodeExporter::Settings& s, float h) {
+        const float w = s.extrusion_width;
+        double bead = (double(w) - h) * h + M_PI * 0.25 * double(h) * h;
+        double fil = M_PI * 0.25 * double(s.filament_dia) * s.filament_dia;
+        double e_per_mm = bead / fil;
+        int print_f = int(std::lround(s.print_speed * 60.f)), travel_f = int(std::lround(s.travel_speed * 60.f));
+        int retract_f = int(std::lround(s.retract_speed * 60.f));
+
+        Vec2 at{};
+        bool placed = false;
+        for(const Path& p : paths) {
+            float hop = placed ? length(p[0] - at) : INFINITY;
+            bool retract = s.retract_mm > 0.f && hop > 2.f;
+            if(retract && placed) {
+                b.put("G1 E"); b.put_fixed(-s.retract_mm, 5); b.put(" F"); b.put(retract_f); b.put('\n');
+            }
+            if(hop > 1e-4f) {
+                b.put("G0 X"); b.put_fixed(p[0].x, 3); b.put(" Y"); b.put_fixed(p[0].y, 3);
+                b.put(" F"); b.put(travel_f); b.put('\n');
+            }
+            if(retract) {
+                b.put("G1 E"); b.put_fixed(s.retract_mm, 5); b.put(" F"); b.put(retract_f); b.put('\n');
+            }
+            for(size_t i = 1; i < p.size(); ++i) {
+                b.put("G1 X"); b.put_fixed(p[i].x, 3); b.put(" Y"); b.put_fixed(p[i].y, 3);
+                b.put(" E"); b.put_fixed(float(length(p[i] - p[i - 1]) * e_per_mm), 5);
+                if(i == 1) { b.put(" F"); b.put(print_f); }
+                b.put('\n');
+            }
+            at = p.back();
+            placed = true;
+        }
+    }
+}
+
+bool GCodeExporter::export_prism(const RingSet& rings, float height, const Settings& s, const char* path) {
+    app::profile::Scope scope("gcode");
+    const float w = s.extrusion_width;
+    int layers = std::max(1, int(std::ceil(height / std::max(s.layer_height, 1e-3f) - 1e-3f)));
+    float h = height / float(layers);
+
+    // the two layer bodies differ in infill direction only
+    text::Buffer body[2];
+    {
+        app::profile::Scope plan("gcode_plan");
+        std::vector<Path> loops;
+        geometry::EdgeGrid grid(rings, (float(std::max(0, s.perimeters)) * 2.f + 1.f) * w);
+        perimeters(rings, grid, s, loops);
+        for(int d = 0; d < 2; ++d) {
+            std::vector<Path> paths = loops;
+            infill(rings, s, d == 1, paths);
+            write_body(body[d], paths, s, h);
+        }
+    }
+
+    app::profile::Scope write("gcode_write");
+    io::StreamSink sink(path);
+    text::Buffer b;
+    b.put("; cell holder plate, "); b.put(layers); b.put(" layers of "); b.put_fixed(h, 3);
+    b.put("mm, extrusion width "); b.put_fixed(w, 3); b.put("mm\n");
+    b.put("M140 S"); b.put(s.bed_temp); b.put("\nM104 S"); b.put(s.nozzle_temp);
+    b.put("\nM190 S"); b.put(s.bed_temp); b.put("\nM109 S"); b.put(s.nozzle_temp);
+    b.put("\nG21\nG90\nM83\nG28\n");
+    int travel_f = int(std::lround(s.travel_speed * 60.f));
+    int retract_f = int(std::lround(s.retract_speed * 60.f));
+    // every body opens by priming the filament back, so it is retracted
+    // before each layer, the first one included
+    for(int l = 0; l < layers; ++l) {
+        b.put("; layer "); b.put(l + 1); b.put('\n');
+        if(s.retract_mm > 0.f) {
+            b.put("G1 E"); b.put_fixed(-s.retract_mm, 5); b.put(" F"); b.put(retract_f); b.put('\n');
+        }
+        b.put("G0 Z"); b.put_fixed(h * float(l + 1), 3); b.put(" F"); b.put(travel_f); b.put('\n');
+        sink.write(b.data(), b.size());
+        b.clear();
+        sink.write(body[l % 2].data(), body[l % 2].size());
+    }
+    b.put("M104 S0\nM140 S0\nG0 Z"); b.put_fixed(height + 10.f, 3);
+    b.put(" F"); b.put(travel_f); b.put("\nM84\n");
+    sink.write(b.data(), b.size());
+    return sink.close();
+}
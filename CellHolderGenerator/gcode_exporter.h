@@ -0,0 +1,30 @@
+#pragma once
+#include "ring_set.h"
+
+// Slices the prism swept by a cross-section straight to G-code. Every layer
+// of a prism is the same, so the toolpaths are planned once from the rings:
+// perimeter loops around each ring and scanline infill in between, with the
+// infill direction alternating between two precomputed layer bodies. Each
+// layer is then a Z move followed by one of the bodies. Extrusion is
+// relative (M83), so the bodies are written again byte for byte.
+class GCodeExporter {
+public:
+    struct Settings {
+        float layer_height = 0.2f;      // rounded so whole layers reach the height
+        float extrusion_width = 0.45f;
+        int   perimeters = 2;
+        float infill_density = 1.0f;    // 1 is solid
+        float print_speed = 40.0f;      // mm/s
+        float travel_speed = 150.0f;    // mm/s
+        float filament_dia = 1.75f;
+        float retract_mm = 0.8f;        // on travels over 2mm; 0 never
+        float retract_speed = 40.0f;    // mm/s
+        int   nozzle_temp = 210;
+        int   bed_temp = 60;
+    };
+
+    // rings as in a geometry::RingSet cross-section: ring 0 is the outline,
+    // every further ring a hole. height is the prism height from z = 0.
+    static bool export_prism(const geometry::RingSet& rings, float height,
+        const Settings& s, const char* path);
+};
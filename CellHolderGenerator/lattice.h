@@ -0,0 +1,17 @@
+#pragma once
+
+namespace geometry {
+    // Regular cell lattice: cell (row, col) is centered at
+    // (x0 + col * pitch + (odd row ? offset : 0), y0 + row * vstep), turned
+    // by angle radians about the origin.
+    struct Lattice {
+        float x0, y0;
+        float pitch;
+        float vstep;
+        float offset;
+        float hole_radius;
+        int   cols, rows;
+        bool  honeycomb;
+        float angle = 0.f;
+    };
+}
\ No newline at end of file
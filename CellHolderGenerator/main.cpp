@@ -1,7 +1,162 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
 #include "application.h"
+#include "cache.h"
+#include "parameters.h"
+#include "profiler.h"
+#include "server.h"
+#include "sweep.h"
+#include "thread_pool.h"
 
-int main() {
-    Application app;
-    app.run();
-    return 0;
-}
\ No newline at end of file
+//   CellHolderGenerator [--config FILE] [--set KEY=VALUE]... [--cache DIR]
+//   CellHolderGenerator --batch MANIFEST [--jobs N] [--out-dir DIR] [--cache DIR]
+//   CellHolderGenerator [--config FILE] [--set KEY=VALUE]... --sweep [--top N]
+//       [--spacing-max MM] [--spacing-step MM] [--all-rows]
+//   CellHolderGenerator --serve [--out-dir DIR] [--cache DIR]
+//   CellHolderGenerator --serve-socket PATH [--out-dir DIR] [--cache DIR]
+// The cache directory is never pruned; delete it to reclaim the space.
+// The first two forms accept --profile or --profile=json; a profiled batch
+// runs its jobs one at a time so stage heap peaks stay per job. The server forms
+// answer JSON-lines requests (see app::Server) on stdin/stdout or a socket.
+
+static int usage(const char* argv0) {
+    std::fprintf(stderr,
+        "usage: %s [--config FILE] [--set KEY=VALUE]... [--cache DIR]\n"
+        "       %s --batch MANIFEST [--jobs N] [--out-dir DIR] [--cache DIR]\n"
+        "       %s [--config FILE] [--set KEY=VALUE]... --sweep [--top N]\n"
+        "           [--spacing-max MM] [--spacing-step MM] [--all-rows]\n"
+        "       %s --serve | --serve-socket PATH [--out-dir DIR] [--cache DIR]\n"
+        "       add --profile or --profile=json to print stage timings;\n"
+        "       a profiled batch runs its jobs one at a time\n"
+        "       --cache DIR is never pruned; delete it to reclaim the space\n"
+        "       --sweep tries spacings from the configured one up to --spacing-max\n"
+        "       (default 1mm more) in --spacing-step steps (default 0.1mm), with the\n"
+        "       most rows that fit, or every row count with --all-rows\n", argv0, argv0, argv0, argv0);
+    return 1;
+}
+
+// Ranks packs for the configured enclosure and cell, from the configured
+// spacing up to spec's spacing_max, aiming for the configured series and
+// parallel counts.
+static int print_sweep(const app::Parameters& p, app::SweepSpec spec) {
+    spec.width = p.width;
+    spec.height = p.height;
+    spec.cell_dia = p.cell_dia;
+    spec.wall_thickness = p.wall_thickness;
+    spec.spacing_min = p.spacing;
+    if(spec.spacing_max < 0.f) spec.spacing_max = p.spacing + 1.0f;
+    spec.target_series = p.series;
+    spec.min_parallel = p.parallel;
+
+    auto ranked = app::sweep(spec);
+    std::printf("%-9s %-7s %7s %6s %8s %9s %9s %8s %s\n",
+        "lattice", "rotated", "spacing", "cells", "pack", "width", "height", "slack", "target");
+    for(const auto& c : ranked) {
+        char pack[32];
+        std::snprintf(pack, sizeof(pack), "%ds%dp", c.series, c.parallel);
+        std::printf("%-9s %-7s %7.2f %6d %8s %9.2f %9.2f %8.2f %s\n",
+            c.honeycomb ? "honeycomb" : "square", c.rotated ? "yes" : "no", c.spacing,
+            c.cells(), pack, c.reqWidth, c.reqHeight, c.slack, c.meets_target ? "yes" : "no");
+    }
+    return ranked.empty() ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    bool profile = false, profile_json = false, sweep = false;
+    app::SweepSpec sweep_spec;
+    sweep_spec.spacing_max = -1.f;  // 1mm past the configured spacing
+    sweep_spec.max_results = 20;
+    const char* batch = nullptr;
+    const char* out_dir = nullptr;
+    const char* cache_dir = nullptr;
+    const char* socket_path = nullptr;
+    bool serve = false;
+    std::string error;
+    app::Parameters params;
+
+    for(int i = 1; i < argc; ++i) {
+        auto arg = [&](const char* name) { return std::strcmp(argv[i], name) == 0 && i + 1 < argc; };
+        if(std::strcmp(argv[i], "--profile") == 0) profile = true;
+        else if(std::strcmp(argv[i], "--profile=json") == 0) profile = profile_json = true;
+        else if(std::strcmp(argv[i], "--sweep") == 0) sweep = true;
+        else if(arg("--top")) sweep_spec.max_results = size_t(std::strtoull(argv[++i], nullptr, 10));
+        else if(arg("--spacing-max") || arg("--spacing-step")) {
+            bool max = std::strcmp(argv[i], "--spacing-max") == 0;
+            float v = std::strtof(argv[++i], nullptr);
+            if(!(v > 0.f) || !std::isfinite(v)) return usage(argv[0]);
+            (max ? sweep_spec.spacing_max : sweep_spec.spacing_step) = v;
+        }
+        else if(std::strcmp(argv[i], "--all-rows") == 0) sweep_spec.all_rows = true;
+        else if(arg("--batch")) batch = argv[++i];
+        else if(arg("--out-dir")) out_dir = argv[++i];
+        else if(arg("--cache")) cache_dir = argv[++i];
+        else if(std::strcmp(argv[i], "--serve") == 0) serve = true;
+        else if(arg("--serve-socket")) socket_path = argv[++i];
+        else if(arg("--jobs")) app::ThreadPool::set_shared_threads(unsigned(std::strtoul(argv[++i], nullptr, 10)));
+        else if(arg("--config")) {
+            if(!app::read_config(argv[++i], params, error)) {
+                std::fprintf(stderr, "%s\n", error.c_str());
+                return 1;
+            }
+        }
+        else if(arg("--set")) {
+            std::string_view s = argv[++i];
+            size_t eq = s.find('=');
+            if(eq == std::string_view::npos || !params.set(s.substr(0, eq), s.substr(eq + 1))) {
+                std::fprintf(stderr, "bad setting '%s'\n", argv[i]);
+                return 1;
+            }
+        }
+        else return usage(argv[0]);
+    }
+    if(sweep) return print_sweep(params, sweep_spec);
+    if(serve || socket_path) {
+        std::unique_ptr<app::Cache> cache;
+        if(cache_dir) cache = std::make_unique<app::Cache>(cache_dir);
+        app::Server server(cache.get(), out_dir ? out_dir : ".");
+        if(!socket_path) {
+            server.serve_stream(stdin, stdout);
+            return 0;
+        }
+        if(!server.serve_socket(socket_path)) {
+            std::fprintf(stderr, "cannot listen on %s\n", socket_path);
+            return 1;
+        }
+        return 0;
+    }
+    if(profile) app::profile::enable();
+
+    Application app(cache_dir);
+    int status = 0;
+    if(batch) {
+        std::vector<app::Parameters> jobs;
+        if(!app::read_manifest(batch, jobs, error)) {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        if(out_dir) {
+            std::filesystem::create_directories(out_dir);
+            for(auto& j : jobs) j.relocate(out_dir);
+        }
+        size_t failed = app.run_batch(jobs);
+        std::printf("%zu of %zu jobs done\n", jobs.size() - failed, jobs.size());
+        status = failed ? 1 : 0;
+    }
+    else {
+        if(out_dir) {
+            std::filesystem::create_directories(out_dir);
+            params.relocate(out_dir);
+        }
+        status = app.run(params) ? 0 : 1;
+    }
+
+    if(profile) app::profile::report(stdout, profile_json);
+    return status;
+}
@@ -0,0 +1,72 @@
+#include "mapped_file.h"
+#include <utility>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using io::MappedFile;
+
+#ifdef _WIN32
+MappedFile::MappedFile(const char* path) {
+    HANDLE h = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(h == INVALID_HANDLE_VALUE) return;
+    LARGE_INTEGER sz;
+    if(GetFileSizeEx(h, &sz) && sz.QuadPart > 0) {
+        HANDLE m = CreateFileMappingA(h, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if(m) {
+            base = static_cast<const char*>(MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0));
+            if(base) len = size_t(sz.QuadPart);
+            CloseHandle(m);
+        }
+    }
+    CloseHandle(h);
+}
+
+void MappedFile::release() {
+    if(base) UnmapViewOfFile(base);
+    base = nullptr;
+    len = 0;
+}
+#else
+MappedFile::MappedFile(const char* path) {
+    int fd = ::open(path, O_RDONLY);
+    if(fd < 0) return;
+    struct stat st;
+    if(::fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* p = ::mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if(p != MAP_FAILED) {
+            base = static_cast<const char*>(p);
+            len = size_t(st.st_size);
+        }
+    }
+    ::close(fd);
+}
+
+void MappedFile::release() {
+    if(base) ::munmap(const_cast<char*>(base), len);
+    base = nullptr;
+    len = 0;
+}
+#endif
+
+MappedFile::~MappedFile() { release(); }
+
+MappedFile::MappedFile(MappedFile&& o) noexcept
+    : base(std::exchange(o.base, nullptr)), len(std::exchange(o.len, 0)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& o) noexcept {
+    if(this != &o) {
+        release();
+        base = std::exchange(o.base, nullptr);
+        len = std::exchange(o.len, 0);
+    }
+    return *this;
+}
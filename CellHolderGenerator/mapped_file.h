@@ -0,0 +1,28 @@
+#pragma once
+#include <cstddef>
+
+namespace io {
+    // Read-only memory mapping of a whole file. Empty (and false) when the
+    // file is missing, empty or cannot be mapped.
+    class MappedFile {
+    public:
+        MappedFile() = default;
+        explicit MappedFile(const char* path);
+        ~MappedFile();
+
+        MappedFile(MappedFile&& o) noexcept;
+        MappedFile& operator=(MappedFile&& o) noexcept;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const char* data() const { return base; }
+        size_t size() const { return len; }
+        explicit operator bool() const { return base != nullptr; }
+
+    private:
+        void release();
+
+        const char* base = nullptr;
+        size_t len = 0;
+    };
+}
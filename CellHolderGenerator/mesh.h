@@ -12,5 +12,5 @@ public:
     std::vector<Vec3> vertices;
     std::vector<Face> faces;
 
-    void export_as_stl(const char* path) const;
+    bool export_as_stl(const char* path) const;
 };
\ No newline at end of file
@@ -0,0 +1,143 @@
+#include "optimizer.h"
+#include "edge_grid.h"
+#include "profiler.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+using app::CellLayout;
+using app::Optimum;
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    struct Probe {
+        bool honeycomb;
+        CellLayout::Placement place;
+        size_t cells;
+    };
+
+    double halton(uint64_t i, unsigned base) {
+        double f = 1.0, r = 0.0;
+        for(; i > 0; i /= base) {
+            f /= base;
+            r += f * double(i % base);
+        }
+        return r;
+    }
+
+    // splitmix64, seeded per layout so a batch does not depend on scheduling
+    double uniform(uint64_t seed) {
+        uint64_t z = seed + 0x9e3779b97f4a7c15ull;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        z ^= z >> 31;
+        return double(z >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    float wrap(double v, double period) {
+        v = std::fmod(v, period);
+        return float(v < 0.0 ? v + period : v);
+    }
+}
+
+Optimum app::optimize_lattice(const geometry::RingSet& boundary, const OptimizeSpec& spec) {
+    profile::Scope scope("optimize_lattice");
+    auto start = Clock::now();
+    auto deadline = start + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(std::max(0.0, spec.seconds)));
+
+    float clear = CellLayout::outlineClearance(spec.cell_dia, spec.spacing, spec.wall_thickness);
+    geometry::EdgeGrid grid(boundary, clear);
+
+    std::vector<bool> types;
+    if(spec.square) types.push_back(false);
+    if(spec.honeycomb) types.push_back(true);
+    if(types.empty()) types.push_back(false);
+
+    // one period of each parameter: lattice step along each axis, and the
+    // turn that maps the lattice onto itself
+    float pitch = spec.cell_dia + spec.spacing;
+    auto vstep = [&](bool honey) { return honey ? pitch * 0.8660254037844386f : pitch; };
+    auto turn = [&](bool honey) { return honey ? M_PI / 3.0 : M_PI / 2.0; };
+
+    auto score = [&](const Probe& p) {
+        return CellLayout::countOutline(boundary, grid, spec.cell_dia, spec.spacing,
+            spec.wall_thickness, p.honeycomb, p.place);
+    };
+
+    Optimum best{ types[0], { 0.f, 0.f, 0.f }, 0, 0, 0.0 };
+    std::vector<Probe> elite;
+    const size_t elite_size = 8;
+    auto offer = [&](const Probe& p) {
+        ++best.evaluated;
+        if(p.cells > best.cells) {
+            best.honeycomb = p.honeycomb;
+            best.placement = p.place;
+            best.cells = p.cells;
+        }
+        auto at = std::find_if(elite.begin(), elite.end(), [&](const Probe& e) { return p.cells > e.cells; });
+        if(size_t(at - elite.begin()) < elite_size) {
+            elite.insert(at, p);
+            if(elite.size() > elite_size) elite.pop_back();
+        }
+    };
+    auto done = [&] {
+        return (spec.target && best.cells >= spec.target)
+            || (spec.max_layouts && best.evaluated >= spec.max_layouts)
+            || Clock::now() >= deadline;
+    };
+
+    for(bool honey : types) {
+        Probe p{ honey, { 0.f, 0.f, 0.f }, 0 };
+        p.cells = score(p);
+        offer(p);
+    }
+
+    auto& pool = ThreadPool::shared();
+    size_t batch = std::max<size_t>(16, 4 * size_t(pool.size()));
+    std::vector<Probe> probes(batch);
+    std::vector<char> scored(batch);
+    uint64_t next_global = 0;
+    for(uint64_t round = 0; !done(); ++round) {
+        if(spec.max_layouts) batch = std::min(batch, spec.max_layouts - best.evaluated);
+        double radius = std::max(1e-3, std::pow(0.5, double(round) / 3.0));
+        for(size_t i = 0; i < batch; ++i) {
+            Probe& p = probes[i];
+            if(i % 2 == 0 || elite.empty()) {
+                // types take turns; each walks its own Halton sequence
+                uint64_t n = next_global++, h = n / types.size() + 1;
+                p.honeycomb = types[n % types.size()];
+                p.place.angle = spec.rotate ? float(halton(h, 2) * turn(p.honeycomb)) : 0.f;
+                p.place.dx = float(halton(h, 3) * pitch);
+                p.place.dy = float(halton(h, 5) * vstep(p.honeycomb));
+            }
+            else {
+                const Probe& e = elite[(i / 2) % elite.size()];
+                uint64_t seed = (round * batch + i) * 3;
+                p.honeycomb = e.honeycomb;
+                p.place.angle = spec.rotate
+                    ? wrap(e.place.angle + (uniform(seed) - 0.5) * radius * turn(e.honeycomb), turn(e.honeycomb))
+                    : 0.f;
+                p.place.dx = wrap(e.place.dx + (uniform(seed + 1) - 0.5) * radius * pitch, pitch);
+                p.place.dy = wrap(e.place.dy + (uniform(seed + 2) - 0.5) * radius * vstep(e.honeycomb),
+                    vstep(e.honeycomb));
+            }
+        }
+
+        pool.parallel_for(batch, [&](size_t i) {
+            scored[i] = Clock::now() < deadline;
+            if(scored[i]) probes[i].cells = score(probes[i]);
+        });
+
+        // a batch cut short by the deadline keeps its scored prefix only, so
+        // the result depends on the number of layouts and not on timing
+        for(size_t i = 0; i < batch && scored[i]; ++i) offer(probes[i]);
+    }
+
+    best.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return best;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include "cell_layout.h"
+#include "ring_set.h"
+
+namespace app {
+    // Cell, lattice types and budget of a placement search.
+    struct OptimizeSpec {
+        float  cell_dia = 21.4f;
+        float  spacing = 0.5f;
+        float  wall_thickness = 0.5f;
+        bool   square = true;      // lattice types to try
+        bool   honeycomb = true;
+        bool   rotate = true;      // false keeps the lattice axis-aligned
+        double seconds = 1.0;      // wall-clock budget
+        size_t max_layouts = 0;    // 0 leaves only the time budget
+        size_t target = 0;         // stop once this many cells fit; 0 never
+    };
+
+    struct Optimum {
+        bool   honeycomb;
+        CellLayout::Placement placement;
+        size_t cells;
+        size_t evaluated;          // layouts scored
+        double seconds;
+    };
+
+    // Anytime search for the lattice type, origin shift and rotation that
+    // fit the most cells into boundary (outline plus keep-outs, as for
+    // CellLayout::packOutline). The anchored, unrotated lattice of each type
+    // is scored first, so the result never loses to the default packing.
+    // After that, batches of layouts are scored in parallel on the shared
+    // pool: half of each batch samples the whole space along a Halton
+    // sequence, half refines the best layouts found so far with a radius
+    // that shrinks every round. Scoring counts cells against one EdgeGrid
+    // of the boundary and builds no rings. The best layout is returned when
+    // the budget runs out, max_layouts have been scored or target is met.
+    // The sequence of layouts is fixed, so equal layout counts give equal
+    // results.
+    Optimum optimize_lattice(const geometry::RingSet& boundary, const OptimizeSpec& spec);
+}
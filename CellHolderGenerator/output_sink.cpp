@@ -0,0 +1,159 @@
+#include "output_sink.h"
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <system_error>
+#include <thread>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using io::MappedSink;
+using io::OutputSink;
+using io::StreamSink;
+
+namespace fs = std::filesystem;
+
+const char* OutputSink::begin(const char* path) {
+    std::error_code ec;
+    fs::path t = path;
+    if(fs::is_symlink(t, ec)) {
+        fs::path resolved = fs::weakly_canonical(t, ec);
+        if(!ec) t = resolved;
+    }
+    // process, thread and a counter, so concurrent writers in one directory
+    // (batch jobs, processes sharing a cache) never pick the same name
+    static std::atomic<uint64_t> serial{ 0 };
+#ifdef _WIN32
+    unsigned long pid = GetCurrentProcessId();
+#else
+    unsigned long pid = (unsigned long)::getpid();
+#endif
+    target = t.string();
+    temp = target + "." + std::to_string(pid)
+        + "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()))
+        + "." + std::to_string(serial.fetch_add(1)) + ".tmp";
+    return temp.c_str();
+}
+
+bool OutputSink::publish(bool ok) {
+    if(temp.empty()) return ok;
+    std::error_code ec;
+    if(ok) {
+        auto old = fs::status(target, ec);
+        if(!ec && fs::exists(old)) fs::permissions(temp, old.permissions(), ec);
+        ec.clear();
+        fs::rename(temp, target, ec);
+        ok = !ec;
+    }
+    if(!ok) fs::remove(temp, ec);
+    temp.clear();
+    return ok;
+}
+
+#ifdef _WIN32
+MappedSink::MappedSink(const char* path, size_t size) : cap(size) {
+    HANDLE h = CreateFileA(begin(path), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(h == INVALID_HANDLE_VALUE) return;
+    file = h;
+    if(size == 0) { good = true; return; }
+
+    LARGE_INTEGER sz; sz.QuadPart = LONGLONG(size);
+    HANDLE m = CreateFileMappingA(h, nullptr, PAGE_READWRITE, sz.HighPart, sz.LowPart, nullptr);
+    if(!m) return;
+    mapping = m;
+    base = static_cast<char*>(MapViewOfFile(m, FILE_MAP_WRITE, 0, 0, size));
+    good = base != nullptr;
+}
+
+bool MappedSink::close() {
+    if(base) { UnmapViewOfFile(base); base = nullptr; }
+    if(mapping) { CloseHandle(mapping); mapping = nullptr; }
+    if(file) {
+        LARGE_INTEGER sz; sz.QuadPart = LONGLONG(used);
+        if(!SetFilePointerEx(file, sz, nullptr, FILE_BEGIN) || !SetEndOfFile(file)) good = false;
+        CloseHandle(file);
+        file = nullptr;
+    }
+    return good = publish(good);
+}
+#else
+MappedSink::MappedSink(const char* path, size_t size) : cap(size) {
+    fd = ::open(begin(path), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) return;
+    if(size == 0) { good = true; return; }
+    if(::ftruncate(fd, off_t(size)) != 0) return;
+
+    void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(p == MAP_FAILED) return;
+    base = static_cast<char*>(p);
+    good = true;
+}
+
+bool MappedSink::close() {
+    if(base) { ::munmap(base, cap); base = nullptr; }
+    if(fd >= 0) {
+        if(::ftruncate(fd, off_t(used)) != 0) good = false;
+        if(::close(fd) != 0) good = false;
+        fd = -1;
+    }
+    return good = publish(good);
+}
+#endif
+
+MappedSink::~MappedSink() { close(); }
+
+bool MappedSink::write(const void* data, size_t n) {
+    if(!good || n > remaining()) return good = false;
+    std::memcpy(base + used, data, n);
+    used += n;
+    return true;
+}
+
+StreamSink::StreamSink(const char* path, size_t buffer_size) : buf(buffer_size) {
+    file = std::fopen(begin(path), "wb");
+    if(!file) return;
+    std::setvbuf(file, nullptr, _IONBF, 0);
+    good = true;
+}
+
+StreamSink::~StreamSink() { close(); }
+
+bool StreamSink::flush() {
+    if(used && std::fwrite(buf.data(), 1, used, file) != used) good = false;
+    used = 0;
+    return good;
+}
+
+bool StreamSink::write(const void* data, size_t n) {
+    if(!good) return false;
+    if(used + n <= buf.size()) {
+        std::memcpy(buf.data() + used, data, n);
+        used += n;
+        return true;
+    }
+    if(!flush()) return false;
+    if(n >= buf.size()) {
+        if(std::fwrite(data, 1, n, file) != n) good = false;
+        return good;
+    }
+    std::memcpy(buf.data(), data, n);
+    used = n;
+    return true;
+}
+
+bool StreamSink::close() {
+    if(file) {
+        flush();
+        if(std::fclose(file) != 0) good = false;
+        file = nullptr;
+    }
+    return good = publish(good);
+}
\ No newline at end of file
@@ -0,0 +1,82 @@
+#pragma once
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace io {
+    // Destination for exporter bytes. Exporters receive an explicit output path
+    // and pick the sink that fits their format. Sinks write a temporary file
+    // beside the target and rename it into place on close(), so a failed
+    // write leaves the old file alone and readers never see half a file. A
+    // symlink at the path is written through, and a replaced file keeps its
+    // permissions.
+    class OutputSink {
+    public:
+        virtual ~OutputSink() = default;
+        virtual bool write(const void* data, size_t n) = 0;
+        virtual bool close() = 0;
+        bool ok() const { return good; }
+        // Makes close() discard the file, for writers that find their own
+        // output wrong.
+        void fail() { good = false; }
+
+    protected:
+        // Chooses the target and the temporary file to create for path.
+        const char* begin(const char* path);
+        // Renames the temporary file over the target if ok, else removes it.
+        bool publish(bool ok);
+
+        bool good = false;
+
+    private:
+        std::string target, temp;
+    };
+
+    // Pre-sized memory-mapped file for formats whose byte size is known before
+    // writing (binary STL, binary DXF). Callers may fill map() directly and
+    // advance with commit(), or use write(). close() trims the file to the
+    // number of bytes actually produced.
+    class MappedSink : public OutputSink {
+    public:
+        MappedSink(const char* path, size_t size);
+        ~MappedSink() override;
+
+        char* map() { return base + used; }
+        size_t remaining() const { return cap - used; }
+        void commit(size_t n) { used += n; }
+
+        bool write(const void* data, size_t n) override;
+        bool close() override;
+
+    private:
+        char* base = nullptr;
+        size_t cap = 0;
+        size_t used = 0;
+#ifdef _WIN32
+        void* file = nullptr;
+        void* mapping = nullptr;
+#else
+        int fd = -1;
+#endif
+    };
+
+    // Streaming writer with a large user-space buffer for formats whose size is
+    // only known after formatting (ASCII STL, text DXF).
+    class StreamSink : public OutputSink {
+    public:
+        explicit StreamSink(const char* path, size_t buffer_size = size_t(4) << 20);
+        ~StreamSink() override;
+
+        bool write(const void* data, size_t n) override;
+        bool close() override;
+
+    private:
+        bool flush();
+
+        std::FILE* file = nullptr;
+        std::vector<char> buf;
+        size_t used = 0;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,241 @@
+#include "parameters.h"
+#include "cell_layout.h"
+#include <charconv>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+
+using app::CellLayout;
+using app::Parameters;
+
+namespace {
+    std::string_view trim(std::string_view s) {
+        size_t b = s.find_first_not_of(" \t\r");
+        if(b == std::string_view::npos) return {};
+        size_t e = s.find_last_not_of(" \t\r");
+        return s.substr(b, e - b + 1);
+    }
+
+    template <typename T>
+    bool parse(std::string_view s, T& out) {
+        T v{};
+        auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), v);
+        if(ec != std::errc() || end != s.data() + s.size()) return false;
+        out = v;
+        return true;
+    }
+
+    bool parse(std::string_view s, bool& out) {
+        if(s == "true" || s == "1" || s == "yes") { out = true; return true; }
+        if(s == "false" || s == "0" || s == "no") { out = false; return true; }
+        return false;
+    }
+
+    // "x,y x,y ..." with at least three points.
+    bool parse_ring(std::string_view s, std::vector<Vec2>& ring) {
+        ring.clear();
+        while(!(s = trim(s)).empty()) {
+            size_t end = s.find_first_of(" \t");
+            std::string_view pt = s.substr(0, end);
+            size_t comma = pt.find(',');
+            Vec2 v;
+            if(comma == std::string_view::npos
+                || !parse(pt.substr(0, comma), v.x) || !parse(pt.substr(comma + 1), v.y)) return false;
+            ring.push_back(v);
+            s = end == std::string_view::npos ? std::string_view{} : s.substr(end);
+        }
+        return ring.size() >= 3;
+    }
+
+    // Calls line(number, text) for every non-empty, non-comment line.
+    template <typename F>
+    bool for_each_line(const char* path, std::string& error, F&& line) {
+        std::ifstream in(path);
+        if(!in) {
+            error = std::string("cannot open ") + path;
+            return false;
+        }
+        std::string buf;
+        for(int n = 1; std::getline(in, buf); ++n) {
+            std::string_view s = buf;
+            s = trim(s.substr(0, s.find('#')));
+            if(s.empty()) continue;
+            if(!line(n, s)) return false;
+        }
+        return true;
+    }
+
+    bool apply(Parameters& p, const char* path, int n, std::string_view s, std::string& error) {
+        size_t eq = s.find('=');
+        if(eq != std::string_view::npos && p.set(trim(s.substr(0, eq)), trim(s.substr(eq + 1))))
+            return true;
+        error = std::string(path) + ":" + std::to_string(n) + ": bad setting '" + std::string(s) + "'";
+        return false;
+    }
+}
+
+void Parameters::set_output_stem(const std::string& stem) {
+    stl_path = stem + ".stl";
+    threemf_path = stem + ".3mf";
+    dxf_path = stem + "_busbars.dxf";
+    if(!gcode_path.empty()) gcode_path = stem + ".gcode";
+    if(!plate_dxf_path.empty()) plate_dxf_path = stem + "_plate.dxf";
+}
+
+void Parameters::relocate(const std::string& dir) {
+    for(std::string* s : { &stl_path, &threemf_path, &dxf_path, &gcode_path, &plate_dxf_path })
+        if(!s->empty() && std::filesystem::path(*s).is_relative()) *s = (std::filesystem::path(dir) / *s).string();
+}
+
+bool Parameters::set(std::string_view key, std::string_view value) {
+    struct Field {
+        const char* key;
+        float Parameters::* f = nullptr;
+        int Parameters::* i = nullptr;
+        bool Parameters::* b = nullptr;
+        bool positive = false;          // float must be > 0, int >= 1
+    };
+    static const Field fields[] = {
+        // a zero-sized plate, hole or wall leaves degenerate or open meshes
+        { "width", &Parameters::width, nullptr, nullptr, true },
+        { "height", &Parameters::height, nullptr, nullptr, true },
+        { "cell_dia", &Parameters::cell_dia, nullptr, nullptr, true },
+        // touching holes leave the plate in pieces that share only points
+        { "spacing", &Parameters::spacing, nullptr, nullptr, true },
+        { "wall_thickness", &Parameters::wall_thickness, nullptr, nullptr, true },
+        { "wall_height", &Parameters::wall_height, nullptr, nullptr, true },
+        // an empty pack has no layout and nothing to wire
+        { "series", nullptr, &Parameters::series, nullptr, true },
+        { "parallel", nullptr, &Parameters::parallel, nullptr, true },
+        { "honeycomb", nullptr, nullptr, &Parameters::honeycomb },
+        { "chord_tol_mm", &Parameters::chord_tol_mm, nullptr, nullptr, true },
+        { "optimize_s", &Parameters::optimize_s },
+        { "rounded_corners", nullptr, nullptr, &Parameters::rounded_corners },
+        { "corner_radius", &Parameters::corner_radius },
+        { "export_3mf", nullptr, nullptr, &Parameters::export_3mf },
+        { "plate_side_clearance", &Parameters::plate_side_clearance },
+        { "end_margin", &Parameters::end_margin },
+        { "weld_diameter", &Parameters::weld_diameter },
+        { "gap_mm", &Parameters::gap_mm },
+        { "dxf_show_cells", nullptr, nullptr, &Parameters::dxf_show_cells },
+        { "dxf_cell_diameter", &Parameters::dxf_cell_diameter },
+        { "dxf_binary", nullptr, nullptr, &Parameters::dxf_binary },
+        // zero would slice nothing, or space infill lines zero apart
+        { "layer_height", &Parameters::layer_height, nullptr, nullptr, true },
+        { "extrusion_width", &Parameters::extrusion_width, nullptr, nullptr, true },
+        { "perimeters", nullptr, &Parameters::perimeters },
+        { "infill_density", &Parameters::infill_density },
+        // feeds and the filament cross-section are divisors
+        { "print_speed", &Parameters::print_speed, nullptr, nullptr, true },
+        { "travel_speed", &Parameters::travel_speed, nullptr, nullptr, true },
+        { "filament_dia", &Parameters::filament_dia, nullptr, nullptr, true },
+        { "retract_mm", &Parameters::retract_mm },
+        // an F0 retract would never finish
+        { "retract_speed", &Parameters::retract_speed, nullptr, nullptr, true },
+        { "nozzle_temp", nullptr, &Parameters::nozzle_temp },
+        { "bed_temp", nullptr, &Parameters::bed_temp },
+    };
+    for(const auto& fd : fields) {
+        if(key != fd.key) continue;
+        if(fd.f) {
+            float v;
+            if(!parse(value, v) || !std::isfinite(v) || (fd.positive && !(v > 0.f))) return false;
+            this->*fd.f = v;
+            return true;
+        }
+        if(fd.i) {
+            int v;
+            if(!parse(value, v) || (fd.positive && v < 1)) return false;
+            this->*fd.i = v;
+            return true;
+        }
+        return parse(value, this->*fd.b);
+    }
+
+    // an empty value puts an outline source or the wiring back to its
+    // default, so a long-lived session can undo them
+    if(value.empty()) {
+        if(key == "outline") outline = {};
+        else if(key == "keepout") {
+            if(outline.size() > 1) {
+                geometry::RingSet ring0;
+                ring0.add_ring(outline[0]);
+                outline = std::move(ring0);
+            }
+        }
+        else if(key == "outline_dxf") outline_dxf.clear();
+        else if(key == "topology") topology = Parameters().topology;
+        else return false;
+        return true;
+    }
+
+    if(key == "outline" || key == "keepout") {
+        std::vector<Vec2> ring;
+        if(!parse_ring(value, ring) || (key == "keepout" && outline.empty())) return false;
+        if(key == "outline") {
+            outline = {};
+            outline_dxf.clear();
+        }
+        outline.add_ring(ring);
+        return true;
+    }
+
+    std::string v(value);
+    if(key == "name") name = v;
+    else if(key == "out") set_output_stem(v);
+    else if(key == "stl") stl_path = v;
+    else if(key == "3mf") threemf_path = v;
+    else if(key == "dxf") dxf_path = v;
+    else if(key == "gcode") gcode_path = v;
+    else if(key == "plate_dxf") plate_dxf_path = v;
+    else if(key == "outline_dxf") {
+        outline_dxf = v;
+        outline = {};
+    }
+    else if(key == "outline_layer") outline_layer = v;
+    else if(key == "topology") {
+        CellLayout::Topology t;
+        if(!CellLayout::parseTopology(v, t)) return false;
+        topology = v;
+    }
+    else return false;
+    return true;
+}
+
+bool app::read_config(const char* path, Parameters& p, std::string& error) {
+    return for_each_line(path, error, [&](int n, std::string_view s) {
+        return apply(p, path, n, s, error);
+    });
+}
+
+bool app::read_manifest(const char* path, std::vector<Parameters>& jobs, std::string& error) {
+    Parameters defaults;
+    bool in_job = false;
+    bool ok = for_each_line(path, error, [&](int n, std::string_view s) {
+        if(s.front() == '[') {
+            std::string_view name = s.size() > 1 && s.back() == ']' ? trim(s.substr(1, s.size() - 2)) : "";
+            if(name.empty()) {
+                error = std::string(path) + ":" + std::to_string(n) + ": bad job header";
+                return false;
+            }
+            // jobs write to files named after them, so two of a name would
+            // overwrite each other, possibly at the same time
+            for(const Parameters& other : jobs)
+                if(other.name == name) {
+                    error = std::string(path) + ":" + std::to_string(n) + ": duplicate job '" + std::string(name) + "'";
+                    return false;
+                }
+            Parameters& job = jobs.emplace_back(defaults);
+            job.name = std::string(name);
+            job.set_output_stem(job.name);
+            in_job = true;
+            return true;
+        }
+        return apply(in_job ? jobs.back() : defaults, path, n, s, error);
+    });
+    if(ok && !in_job) {
+        error = std::string(path) + ": no [job] sections";
+        return false;
+    }
+    return ok;
+}
@@ -1 +1,107 @@
 #pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ring_set.h"
+
+namespace app {
+    // Everything one holder is generated from. Defaults reproduce the
+    // original hard-coded 20s6p pack.
+    struct Parameters {
+        std::string name = "cellholder";
+
+        // plate
+        float width = 460.0f;
+        float height = 140.0f;
+        float cell_dia = 21.4f;
+        float spacing = 0.5f;           // between holes; must be > 0
+        float wall_thickness = 0.5f;
+        float wall_height = 10.0f;
+        int   series = 20;
+        int   parallel = 6;
+        bool  honeycomb = true;
+        float chord_tol_mm = 0.005f;
+        bool  rounded_corners = true;
+        float corner_radius = 5.0f;
+        bool  export_3mf = true;
+
+        // Arbitrary plate outline: ring 0 is the outline, further rings are
+        // keep-outs. When set, cells are packed into it instead of the
+        // width x height rectangle.
+        geometry::RingSet outline;
+
+        // Outline read from a DXF drawing instead, optionally from one layer
+        // only. Setting either outline source clears the other.
+        std::string outline_dxf;
+        std::string outline_layer;
+
+        // Seconds spent searching lattice type, origin and rotation for the
+        // placement that fits the most cells; 0 keeps the anchored lattice
+        // of the chosen type. The search packs an outline; without one it
+        // packs the plate the fixed rectangle would get, or the whole
+        // width x height box when the fixed rectangle does not fit.
+        float optimize_s = 0.0f;
+
+        // busbars. The cells are wired into series groups of parallel cells
+        // in the order topology names ("columns", "serpentine" or "u", see
+        // CellLayout::Topology). Groups that are a rectangle's columns get
+        // busbars through the row midlines, reaching plate_side_clearance
+        // past the outer columns and end_margin past the end rows; any other
+        // wiring, and every packed outline, gets busbars over the cells'
+        // Voronoi regions, reaching plate_side_clearance past each cell.
+        std::string topology = "columns";
+        float plate_side_clearance = 6.0f;
+        float end_margin = 6.0f;
+        float weld_diameter = 6.0f;
+        float gap_mm = 10.0f;
+        bool  dxf_show_cells = true;
+        float dxf_cell_diameter = 0.0f; // 0 uses cell_dia
+        bool  dxf_binary = false;       // binary DXF for both DXF outputs
+
+        // G-code, written only when gcode_path is set
+        float layer_height = 0.2f;      // must be > 0
+        float extrusion_width = 0.45f;  // must be > 0
+        int   perimeters = 2;
+        float infill_density = 1.0f;
+        float print_speed = 40.0f;      // mm/s
+        float travel_speed = 150.0f;    // mm/s
+        float filament_dia = 1.75f;
+        float retract_mm = 0.8f;
+        float retract_speed = 40.0f;    // mm/s
+        int   nozzle_temp = 210;
+        int   bed_temp = 60;
+
+        // outputs
+        std::string stl_path = "cellholder.stl";
+        std::string threemf_path = "cellholder.3mf";
+        std::string dxf_path = "busbars.dxf";
+        std::string gcode_path;
+        std::string plate_dxf_path;     // exact-arc cut drawing of the plate
+
+        // Points all three outputs at stem.stl, stem.3mf and stem_busbars.dxf,
+        // and set G-code and plate outputs at stem.gcode and stem_plate.dxf.
+        void set_output_stem(const std::string& stem);
+
+        // Places relative output paths under dir.
+        void relocate(const std::string& dir);
+
+        // Assigns one "key = value" setting. Keys are the member names above,
+        // plus "out" for set_output_stem and "stl", "3mf", "dxf", "gcode",
+        // "plate_dxf" for single paths. "outline" replaces the outline by one ring and "keepout"
+        // adds one, both written as "x,y x,y x,y ...". An empty value resets
+        // "outline", "keepout" (all of them), "outline_dxf" and "topology" to
+        // their defaults. Returns false for unknown keys and malformed values,
+        // including non-finite numbers, plate, hole and wall sizes, feeds and
+        // filament diameter <= 0, and series or parallel below 1.
+        bool set(std::string_view key, std::string_view value);
+    };
+
+    // Config files hold one "key = value" per line; '#' starts a comment.
+    bool read_config(const char* path, Parameters& p, std::string& error);
+
+    // A manifest is a config file split into jobs by "[name]" lines. Settings
+    // before the first job are defaults for every job. Each job starts from
+    // those defaults with its name as output stem, then applies its own lines.
+    // Job names must be unique.
+    bool read_manifest(const char* path, std::vector<Parameters>& jobs, std::string& error);
+}
@@ -0,0 +1,385 @@
+#include "pipeline.h"
+#include "extrusion.h"
+#include "gcode_exporter.h"
+#include "optimizer.h"
+#include "profiler.h"
+#include "stl_exporter.h"
+#include "threemf_exporter.h"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <span>
+
+using app::CacheKey;
+using app::Pipeline;
+
+template <typename T>
+static std::string bytes_of(const std::vector<T>& v) {
+    auto b = app::as_bytes(v);
+    return { b.begin(), b.end() };
+}
+
+void Pipeline::mark(Node& n, const CacheKey& k, const char* name) {
+    n.key = k.data();
+    ran.push_back(name);
+}
+
+void Pipeline::invalidate() {
+    for(Node* n : { &fit_node, &layout_node, &rings_node, &cap_node, &stl_node, &threemf_node, &gcode_node, &plate_node, &busbars_node, &dxf_node })
+        n->key.clear();
+    drawn_key.clear();
+}
+
+bool Pipeline::update_fit(const Parameters& p) {
+    ran.clear();
+
+    // an outline packs its cells directly; the pack is its fit test
+    const geometry::RingSet* outline = &p.outline;
+    if(!p.outline_dxf.empty()) {
+        if(!read_outline(p)) return false;
+        outline = &drawn.rings;
+    }
+    // without an outline the search packs the plate the anchored lattice
+    // would get, or the whole box if that lattice does not fit. The plate
+    // fits that lattice exactly, so a micron of slack keeps rounding from
+    // costing it its last row or column.
+    if(outline->empty() && p.optimize_s > 0.0f) {
+        CellLayout::FitResult anchored = CellLayout::fitRect(p.width, p.height, p.cell_dia, p.spacing,
+            p.wall_thickness, p.series, p.parallel, p.honeycomb);
+        float w = anchored.fits ? std::min(p.width, anchored.reqWidth) : p.width;
+        float h = anchored.fits ? std::min(p.height, anchored.reqHeight) : p.height;
+        box = CellLayout::plateOutline(w + 1e-3f, h + 1e-3f, 0.f, p.chord_tol_mm, p.rounded_corners, p.corner_radius);
+        outline = &box;
+    }
+    packed = !outline->empty();
+    size_t cells = size_t(std::max(0, p.series)) * size_t(std::max(0, p.parallel));
+
+    // cells and lattice sites are allocated up front, so a pack or a plate
+    // far beyond any real holder would exhaust memory rather than fail; a
+    // turned lattice covers at most the square on the outline's diagonal
+    constexpr double max_sites = double(1 << 24);
+    double sites = double(cells);
+    if(packed) {
+        Vec2 lo = (*outline)[0][0], hi = lo;
+        for(const Vec2& v : (*outline)[0]) {
+            lo = { std::min(lo.x, v.x), std::min(lo.y, v.y) };
+            hi = { std::max(hi.x, v.x), std::max(hi.y, v.y) };
+        }
+        double w = double(hi.x) - lo.x, h = double(hi.y) - lo.y, pitch = double(p.cell_dia) + p.spacing;
+        sites = std::max(sites, (w * w + h * h) / (pitch * pitch * 0.8660254037844386));
+    }
+    if(!(sites <= max_sites)) {
+        std::printf("%s: pack or plate too large: about %.3g cell sites, at most %.3g\n",
+            p.name.c_str(), sites, max_sites);
+        return false;
+    }
+    CacheKey fit_key("fit");
+    fit_key.add(p.width).add(p.height).add(p.cell_dia).add(p.spacing)
+        .add(p.wall_thickness).add(p.series).add(p.parallel).add(p.honeycomb);
+    if(packed) {
+        fit_key.add(p.optimize_s).add(bytes_of(outline->pts)).add(bytes_of(outline->offsets));
+    }
+    if(!fit_node.current(fit_key)) {
+        if(packed) {
+            bool honeycomb = p.honeycomb;
+            CellLayout::Placement place{ 0.f, 0.f, 0.f };
+            if(p.optimize_s > 0.0f) {
+                OptimizeSpec spec;
+                spec.cell_dia = p.cell_dia;
+                spec.spacing = p.spacing;
+                spec.wall_thickness = p.wall_thickness;
+                spec.seconds = p.optimize_s;
+                spec.target = cells;
+                Optimum best = optimize_lattice(*outline, spec);
+                std::printf("%s: lattice optimizer: %zu cells (%s, %.2f deg, offset %.2f,%.2f) after %zu layouts\n",
+                    p.name.c_str(), best.cells, best.honeycomb ? "honeycomb" : "square",
+                    best.placement.angle * 57.29577951308232, best.placement.dx, best.placement.dy, best.evaluated);
+                honeycomb = best.honeycomb;
+                place = best.placement;
+            }
+            profile::Scope scope("packOutline");
+            packing = CellLayout::packOutline(
+                *outline, p.cell_dia, p.spacing, p.wall_thickness,
+                honeycomb, cells, place
+            );
+            fit_result = { packing.layout.cells.size() == cells, 0, 0, 0.f, 0.f, 0.f, 0.f };
+        }
+        else {
+            profile::Scope scope("fitRect");
+            fit_result = CellLayout::fitRect(
+                p.width, p.height, p.cell_dia, p.spacing,
+                p.wall_thickness, p.series, p.parallel, p.honeycomb
+            );
+        }
+        mark(fit_node, fit_key, "fit");
+    }
+    return true;
+}
+
+bool Pipeline::update(const Parameters& p) {
+    profile::Scope total("run");
+    if(!update_fit(p)) return false;
+    bool ok = true;
+
+    const auto& fit = fit_result;
+    if(packed && !fit.fits) {
+        std::printf("%s: %ds%dp won't fit: outline holds %zu cells\n",
+            p.name.c_str(), p.series, p.parallel, packing.layout.cells.size());
+        return false;
+    }
+    if(!fit.fits) {
+        std::printf("%s: %ds%dp won't fit: need +%.2fmm width, +%.2fmm height. Max: %ds%dp\n",
+            p.name.c_str(), p.series, p.parallel, fit.deltaWidth, fit.deltaHeight,
+            fit.maxSeries, fit.maxParallel);
+        return false;
+    }
+
+    float W = std::min(p.width, fit.reqWidth);
+    float H = std::min(p.height, fit.reqHeight);
+    float cell_circle_r = 0.5f * (p.dxf_cell_diameter > 0.0f ? p.dxf_cell_diameter : p.cell_dia);
+
+    // Content keys name results independent of where they are written; the
+    // output nodes add their path so a rename rewrites the file.
+    CacheKey layout_key("layout");
+    // an optimized placement depends on the time it got, so the lattice it
+    // settled on is part of the key
+    if(packed) layout_key.add(fit_node.key).add(p.chord_tol_mm).add(packing.lattice.x0).add(packing.lattice.y0)
+        .add(packing.lattice.angle).add(packing.lattice.honeycomb);
+    else layout_key.add(W).add(H).add(p.cell_dia).add(p.spacing).add(p.wall_thickness)
+        .add(p.series).add(p.parallel).add(p.chord_tol_mm).add(p.honeycomb)
+        .add(p.rounded_corners).add(p.corner_radius);
+    CacheKey cap_key("cap"), stl_key("stl"), threemf_key("3mf"), gcode_key("gcode"), busbars_key("busbars"), dxf_key("dxf");
+    cap_key.add(layout_key);
+    stl_key.add(cap_key).add(p.wall_height);
+    threemf_key.add(cap_key).add(p.wall_height);
+    gcode_key.add(layout_key).add(p.wall_height).add(p.layer_height).add(p.extrusion_width)
+        .add(p.perimeters).add(p.infill_density).add(p.print_speed).add(p.travel_speed)
+        .add(p.filament_dia).add(p.retract_mm).add(p.retract_speed).add(p.nozzle_temp).add(p.bed_temp);
+    busbars_key.add(layout_key).add(p.topology).add(p.plate_side_clearance).add(p.end_margin)
+        .add(p.weld_diameter).add(p.gap_mm);
+    dxf_key.add(busbars_key).add(p.dxf_show_cells).add(cell_circle_r).add(p.dxf_binary);
+
+    // the plate drawing is built from the layout alone
+    CacheKey plate_key("plate");
+    plate_key.add(layout_key).add(p.dxf_binary);
+
+    CacheKey stl_out(stl_key), threemf_out(threemf_key), gcode_out(gcode_key), plate_out(plate_key), dxf_out(dxf_key);
+    stl_out.add(p.stl_path);
+    threemf_out.add(p.threemf_path);
+    gcode_out.add(p.gcode_path);
+    plate_out.add(p.plate_dxf_path);
+    dxf_out.add(p.dxf_path);
+
+    // outputs found in the disk cache need no geometry at all
+    auto served = [&](Node& n, const CacheKey& out, const CacheKey& content,
+        const std::string& path, const char* name) {
+        if(n.current(out)) return true;
+        if(!cache) return false;
+        profile::Scope scope("cache_copy_out");
+        if(!cache->copy_out(content, path.c_str())) return false;
+        mark(n, out, name);
+        return true;
+    };
+    bool need_stl = !served(stl_node, stl_out, stl_key, p.stl_path, "stl");
+    bool need_3mf = p.export_3mf && !served(threemf_node, threemf_out, threemf_key, p.threemf_path, "3mf");
+    bool need_gcode = !p.gcode_path.empty() && !served(gcode_node, gcode_out, gcode_key, p.gcode_path, "gcode");
+    bool need_plate = !p.plate_dxf_path.empty() && !served(plate_node, plate_out, plate_key, p.plate_dxf_path, "plate");
+    bool need_dxf = !served(dxf_node, dxf_out, dxf_key, p.dxf_path, "dxf");
+    if(!need_stl && !need_3mf && !need_gcode && !need_plate && !need_dxf) return true;
+
+    auto find = [&](const CacheKey& key) {
+        return cache ? cache->find(key) : Cache::Entry{};
+    };
+
+    if(!layout_node.current(layout_key)) {
+        if(packed) cell_layout = packing.layout;
+        else {
+            profile::Scope scope("rectangleLayout");
+            cell_layout = CellLayout::rectangleLayout(
+                W, H, p.cell_dia, p.spacing, p.wall_thickness,
+                p.series, p.parallel, p.chord_tol_mm, p.honeycomb,
+                p.rounded_corners, p.corner_radius
+            );
+        }
+        mark(layout_node, layout_key, "layout");
+    }
+
+    // hole rings only for the outputs that mesh or slice them
+    if((need_stl || need_gcode) && !rings_node.current(layout_key)) {
+        if(auto hit = packed ? Cache::Entry{} : find(layout_key); hit && hit.arrays() == 2) {
+            auto pts = hit.array<Vec2>(0);
+            auto offsets = hit.array<uint32_t>(1);
+            ring_set.pts.assign(pts.begin(), pts.end());
+            ring_set.offsets.assign(offsets.begin(), offsets.end());
+        }
+        else {
+            profile::Scope scope("expand_rings");
+            ring_set = cell_layout.rings(p.chord_tol_mm);
+            if(cache && !packed) cache->store(layout_key, { as_bytes(ring_set.pts), as_bytes(ring_set.offsets) });
+        }
+        mark(rings_node, layout_key, "rings");
+    }
+
+    if(need_stl && !cap_node.current(cap_key)) {
+        if(auto hit = find(cap_key); hit && hit.arrays() == 2) {
+            auto extra = hit.array<Vec2>(0);
+            auto indices = hit.array<uint32_t>(1);
+            cached_cap.extra.assign(extra.begin(), extra.end());
+            cached_cap.indices.assign(indices.begin(), indices.end());
+            cap = &cached_cap;
+        }
+        else {
+            profile::Scope scope("triangulate_lattice");
+            cap = packed
+                ? &triangulator.triangulate_lattice(ring_set, packing.lattice, packing.cell_ring)
+                : &triangulator.triangulate_lattice(ring_set, CellLayout::lattice(
+                    p.cell_dia, p.spacing, p.wall_thickness, p.series, p.parallel, p.honeycomb
+                ));
+            if(cache) cache->store(cap_key, { as_bytes(cap->extra), as_bytes(cap->indices) });
+        }
+        mark(cap_node, cap_key, "cap");
+    }
+
+    if(need_dxf && !busbars_node.current(busbars_key)) {
+        CellLayout::Topology topology = CellLayout::Topology::Columns;
+        CellLayout::parseTopology(p.topology, topology);
+        CellLayout::assignSeries(cell_layout, p.series, p.parallel, topology);
+        // a rectangle wired by columns keeps its row-midline busbars
+        bool columns = !packed && std::all_of(cell_layout.cells.begin(), cell_layout.cells.end(),
+            [](const CellLayout::Cell& c) { return c.group == c.col; });
+        if(columns) {
+            profile::Scope scope("busbars_series_groups");
+            busbars = dxf::busbars_series_groups(
+                cell_layout.centers(), p.series, p.parallel, p.honeycomb,
+                p.plate_side_clearance, p.end_margin, p.weld_diameter, p.gap_mm
+            );
+        }
+        else {
+            profile::Scope scope("busbars_cell_groups");
+            std::vector<int> groups;
+            groups.reserve(cell_layout.cells.size());
+            for(const auto& c : cell_layout.cells) groups.push_back(c.group);
+            busbars = dxf::busbars_cell_groups(cell_layout.centers(), groups, p.series,
+                0.5f * p.cell_dia + p.plate_side_clearance, p.gap_mm, p.chord_tol_mm);
+        }
+        mark(busbars_node, busbars_key, "busbars");
+    }
+
+    // a failed write leaves its node invalid so the next update retries it
+    auto finish = [&](Node& n, bool written, const CacheKey& out, const CacheKey& content,
+        const std::string& path, const char* name) {
+        if(!written) {
+            std::printf("failed to write %s\n", path.c_str());
+            n.key.clear();
+            ok = false;
+            return;
+        }
+        mark(n, out, name);
+        if(cache) cache->store_file(content, path.c_str());
+    };
+    if(need_stl) finish(stl_node, write_stl(p), stl_out, stl_key, p.stl_path, "stl");
+    if(need_3mf) finish(threemf_node, write_3mf(p), threemf_out, threemf_key, p.threemf_path, "3mf");
+    if(need_gcode) finish(gcode_node, write_gcode(p), gcode_out, gcode_key, p.gcode_path, "gcode");
+    if(need_plate) finish(plate_node, write_plate(p), plate_out, plate_key, p.plate_dxf_path, "plate");
+    if(need_dxf) finish(dxf_node, write_dxf(p, cell_circle_r), dxf_out, dxf_key, p.dxf_path, "dxf");
+    return ok;
+}
+
+bool Pipeline::read_outline(const Parameters& p) {
+    std::error_code ec;
+    auto stamp = std::filesystem::last_write_time(p.outline_dxf, ec);
+    CacheKey key("outline");
+    key.add(p.outline_dxf).add(p.outline_layer).add(p.chord_tol_mm)
+        .add(ec ? int64_t(0) : int64_t(stamp.time_since_epoch().count()));
+    if(key.data() == drawn_key) return true;
+
+    std::string error;
+    drawn_key.clear();
+    if(!dxf::read_outline(p.outline_dxf.c_str(), p.chord_tol_mm, p.outline_layer, drawn, error)) {
+        std::printf("%s: %s\n", p.name.c_str(), error.c_str());
+        return false;
+    }
+    if(drawn.open)
+        std::printf("%s: %s: %zu open contours ignored\n", p.name.c_str(), p.outline_dxf.c_str(), drawn.open);
+    drawn_key = key.data();
+    ran.push_back("outline");
+    return true;
+}
+
+bool Pipeline::write_stl(const Parameters& p) {
+    profile::Scope scope("extrude_stl");
+    geometry::Section section{ ring_set, cap->indices, cap->extra };
+    STLExporter::BinaryWriter stl(p.stl_path.c_str(), uint32_t(geometry::extruded_triangle_count(section)));
+    geometry::extrude(section, p.wall_height, stl);
+    return stl.close();
+}
+
+// Closed pieces only: the plate with a collar-sized hole per cell once, and
+// the collar around one round hole once, instanced per cell. The plate's
+// holes are coarse, so its cap is cheaper than the STL's, and the round
+// holes with the fine triangles around them are written a single time.
+bool Pipeline::write_3mf(const Parameters& p) {
+    profile::Scope scope("3mf");
+    auto hole = CellLayout::holeTemplate(p.cell_dia, p.chord_tol_mm);
+    auto collar = CellLayout::collarTemplate(p.cell_dia, p.spacing);
+
+    geometry::RingSet plate = cell_layout.rings(collar);
+    geometry::Lattice L = packed ? packing.lattice
+        : CellLayout::lattice(p.cell_dia, p.spacing, p.wall_thickness, p.series, p.parallel, p.honeycomb);
+    L.hole_radius = 0.5f * p.cell_dia + 0.25f * p.spacing;
+    const auto& plate_cap = packed
+        ? plate_triangulator.triangulate_lattice(plate, L, packing.cell_ring)
+        : plate_triangulator.triangulate_lattice(plate, L);
+    Mesh body = geometry::extrude_mesh({ plate, plate_cap.indices, plate_cap.extra }, p.wall_height);
+
+    // the collar's outside runs counter-clockwise as an outline does
+    geometry::RingSet ring;
+    ring.add_ring(std::vector<Vec2>(collar.rbegin(), collar.rend()));
+    ring.add_ring(hole);
+    const std::vector<Vec2> none;
+    Mesh part = geometry::extrude_mesh({ ring, plate_triangulator.triangulate(ring), none }, p.wall_height);
+
+    auto centers = cell_layout.centers();
+    std::vector<Vec3> offsets;
+    offsets.reserve(centers.size());
+    for(const auto& c : centers) offsets.push_back({ c.x, c.y, 0.f });
+    return ThreeMFExporter::export_instanced(body, part, offsets, p.threemf_path.c_str());
+}
+
+bool Pipeline::write_gcode(const Parameters& p) {
+    GCodeExporter::Settings s;
+    s.layer_height = p.layer_height;
+    s.extrusion_width = p.extrusion_width;
+    s.perimeters = p.perimeters;
+    s.infill_density = p.infill_density;
+    s.print_speed = p.print_speed;
+    s.travel_speed = p.travel_speed;
+    s.filament_dia = p.filament_dia;
+    s.retract_mm = p.retract_mm;
+    s.retract_speed = p.retract_speed;
+    s.nozzle_temp = p.nozzle_temp;
+    s.bed_temp = p.bed_temp;
+    return GCodeExporter::export_prism(ring_set, p.wall_height, s, p.gcode_path.c_str());
+}
+
+bool Pipeline::write_plate(const Parameters& p) {
+    float hole_r = 0.5f * p.cell_dia;
+    auto centers = cell_layout.centers();
+    dxf::Drawing plate = packed
+        ? dxf::holder_outline(cell_layout.boundary, centers, hole_r)
+        : dxf::holder_rect(std::min(p.width, fit_result.reqWidth), std::min(p.height, fit_result.reqHeight),
+            p.wall_thickness, p.rounded_corners, p.corner_radius, centers, hole_r);
+    return p.dxf_binary ? dxf::save_binary(plate, p.plate_dxf_path.c_str())
+        : dxf::save(plate, p.plate_dxf_path.c_str());
+}
+
+bool Pipeline::write_dxf(const Parameters& p, float cell_circle_r) {
+    dxf::Drawing drawing = busbars;
+    if(p.dxf_show_cells) {
+        drawing.circles.reserve(drawing.circles.size() + cell_layout.cells.size());
+        for(const auto& cell : cell_layout.cells)
+            drawing.circles.push_back({ cell.center.x, cell.center.y, cell_circle_r, "CELLS" });
+    }
+    return p.dxf_binary ? dxf::save_binary(drawing, p.dxf_path.c_str())
+        : dxf::save(drawing, p.dxf_path.c_str());
+}
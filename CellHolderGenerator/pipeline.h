@@ -0,0 +1,104 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "cache.h"
+#include "cell_layout.h"
+#include "dxf_exporter.h"
+#include "dxf_reader.h"
+#include "parameters.h"
+#include "ring_set.h"
+#include "triangulator.h"
+
+namespace app {
+    // Generation as a graph of stages:
+    //
+    //   [outline] -> fit -> layout -> rings -> cap -> stl
+    //                          |        |       `--> 3mf
+    //                          |        `-> [gcode]
+    //                          |-> [plate]
+    //                          `-> busbars -> dxf
+    //
+    // Each node keys itself on exactly the parameters it reads plus the keys
+    // of the nodes it reads, and update() recomputes a node only when its key
+    // changed since the previous update. Moving a slider for wall_height
+    // rewrites STL and 3MF from the kept cap; changing gap_mm only redoes the
+    // busbars and the DXF. The layout holds where the cells are; the hole
+    // rings are expanded from it only when STL, 3MF or G-code has to be
+    // written, so the busbars, the DXF and the plate drawing never touch
+    // tessellated holes. G-code is sliced from the rings directly and the
+    // plate drawing is drawn from the layout, each only when its path is
+    // set. Results that are not in memory are looked up in the optional disk
+    // cache before being computed. With an outline set,
+    // fit packs the cells into it and the layout is that packing;
+    // optimize_s makes fit search the placement first; without an outline
+    // it packs the plate a fixed rectangle would get, rounded corners
+    // included, or the whole width x height box if that does not fit. A DXF outline is read again only when its
+    // file, layer or tolerance changed.
+    //
+    // A Pipeline is not thread-safe; use one per editing session or job.
+    // Output files are assumed to stay as written between updates.
+    class Pipeline {
+    public:
+        explicit Pipeline(const Cache* cache = nullptr) : cache(cache) {}
+
+        // Brings every output up to date with p. Returns false if the pack
+        // does not fit, needs more than 2^24 cell sites (the pack, or the
+        // lattice over a packed plate), or an output could not be written;
+        // failed nodes are retried on the next update.
+        bool update(const Parameters& p);
+
+        // Runs only the stages update() starts with: reads the outline and
+        // packs or fits the cells, writing nothing. Returns false if the
+        // outline cannot be read or the pack is too large; fit() and
+        // packed_cells() then tell whether it fits.
+        bool update_fit(const Parameters& p);
+
+        // Forgets every result, so the next update recomputes all nodes.
+        void invalidate();
+
+        // Nodes the last update recomputed or reloaded, in run order.
+        const std::vector<const char*>& recomputed() const { return ran; }
+
+        const CellLayout::FitResult& fit() const { return fit_result; }
+        // Whether the cells were packed into an outline, and how many it holds.
+        bool packed_outline() const { return packed; }
+        size_t packed_cells() const { return packing.layout.cells.size(); }
+        const CellLayout::Layout& layout() const { return cell_layout; }
+        // As of the last update that wrote STL, 3MF or G-code.
+        const geometry::RingSet& rings() const { return ring_set; }
+
+    private:
+        // Last key a node was computed for; empty while the node is invalid.
+        struct Node {
+            std::string key;
+            bool current(const CacheKey& k) const { return !key.empty() && key == k.data(); }
+        };
+
+        bool read_outline(const Parameters& p);
+        bool write_stl(const Parameters& p);
+        bool write_3mf(const Parameters& p);
+        bool write_gcode(const Parameters& p);
+        bool write_plate(const Parameters& p);
+        bool write_dxf(const Parameters& p, float cell_circle_r);
+        void mark(Node& n, const CacheKey& k, const char* name);
+
+        const Cache* cache;
+        std::vector<const char*> ran;
+
+        Node fit_node, layout_node, rings_node, cap_node, stl_node, threemf_node, gcode_node, plate_node, busbars_node, dxf_node;
+
+        CellLayout::FitResult fit_result{};
+        std::string drawn_key;
+        dxf::Outline drawn;
+        geometry::RingSet box;
+        bool packed = false;
+        CellLayout::Packing packing;
+        CellLayout::Layout cell_layout;
+        geometry::RingSet ring_set;
+        geometry::Triangulator triangulator;
+        geometry::Triangulator plate_triangulator;  // the 3MF's plate and collar
+        geometry::CapTriangulation cached_cap;
+        const geometry::CapTriangulation* cap = &cached_cap;
+        dxf::Drawing busbars;
+    };
+}
@@ -0,0 +1,51 @@
+#include "point_grid.h"
+#include <algorithm>
+#include <cmath>
+
+using geometry::PointGrid;
+
+void PointGrid::build(std::span<const Vec2> pts, float cell_size) {
+    sorted.clear();
+    ids.clear();
+    first.assign(1, 0);
+    nx = ny = 0;
+    if(pts.empty()) return;
+
+    lo_x = lo_y = INFINITY;
+    hi_x = hi_y = -INFINITY;
+    for(const Vec2& p : pts) {
+        lo_x = std::min(lo_x, p.x); hi_x = std::max(hi_x, p.x);
+        lo_y = std::min(lo_y, p.y); hi_y = std::max(hi_y, p.y);
+    }
+    double w = double(hi_x) - lo_x, h = double(hi_y) - lo_y;
+    double cs = std::max(double(cell_size), 1e-6 * std::max({ w, h, 1.0 }));
+    double limit = 4.0 * double(pts.size()) + 64.0;
+    double cells = (std::floor(w / cs) + 1.0) * (std::floor(h / cs) + 1.0);
+    if(cells > limit) cs *= std::sqrt(cells / limit) * 1.01;
+    inv_cell = float(1.0 / cs);
+    nx = int(std::floor(w / cs)) + 1;
+    ny = int(std::floor(h / cs)) + 1;
+
+    // counting pass, prefix sums, then fill
+    size_t n = size_t(nx) * size_t(ny);
+    first.assign(n + 1, 0);
+    auto bucket = [&](const Vec2& p) { return size_t(row(p.y)) * size_t(nx) + size_t(col(p.x)); };
+    for(const Vec2& p : pts) ++first[bucket(p) + 1];
+    for(size_t c = 0; c < n; ++c) first[c + 1] += first[c];
+    sorted.resize(pts.size());
+    ids.resize(pts.size());
+    std::vector<uint32_t> at(first.begin(), first.end() - 1);
+    for(uint32_t i = 0; i < uint32_t(pts.size()); ++i) {
+        uint32_t k = at[bucket(pts[i])]++;
+        sorted[k] = pts[i];
+        ids[k] = i;
+    }
+}
+
+int PointGrid::col(float x) const {
+    return std::clamp(int(std::floor((x - lo_x) * inv_cell)), 0, nx - 1);
+}
+
+int PointGrid::row(float y) const {
+    return std::clamp(int(std::floor((y - lo_y) * inv_cell)), 0, ny - 1);
+}
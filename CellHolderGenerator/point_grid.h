@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "vec2.h"
+
+namespace geometry {
+    // Uniform-grid spatial hash over points for fixed-radius neighbour
+    // queries. Points are bucketed by a counting sort, so building is linear
+    // and a query only looks at the buckets its radius overlaps.
+    class PointGrid {
+    public:
+        PointGrid() = default;
+        explicit PointGrid(std::span<const Vec2> pts, float cell_size) { build(pts, cell_size); }
+
+        // Buckets of about cell_size; coarsened like EdgeGrid's when the
+        // bounds would need far more buckets than there are points.
+        void build(std::span<const Vec2> pts, float cell_size);
+
+        // Calls f(i) for every point i within r of p, bucket by bucket.
+        template <typename F>
+        void near(Vec2 p, float r, F&& f) const {
+            if(ids.empty() || p.x + r < lo_x || p.y + r < lo_y || p.x - r > hi_x || p.y - r > hi_y) return;
+            int x0 = col(p.x - r), x1 = col(p.x + r), y0 = row(p.y - r), y1 = row(p.y + r);
+            float rr = r * r;
+            for(int y = y0; y <= y1; ++y)
+                for(int x = x0; x <= x1; ++x) {
+                    size_t c = size_t(y) * size_t(nx) + size_t(x);
+                    for(uint32_t k = first[c]; k < first[c + 1]; ++k) {
+                        float dx = sorted[k].x - p.x, dy = sorted[k].y - p.y;
+                        if(dx * dx + dy * dy <= rr) f(ids[k]);
+                    }
+                }
+        }
+
+        size_t size() const { return ids.size(); }
+
+    private:
+        int col(float x) const;
+        int row(float y) const;
+
+        std::vector<Vec2> sorted;       // points in bucket order
+        std::vector<uint32_t> ids;      // their indices in build order
+        std::vector<uint32_t> first;
+        float lo_x = 0, lo_y = 0, hi_x = 0, hi_y = 0;
+        float inv_cell = 1;
+        int nx = 0, ny = 0;
+    };
+}
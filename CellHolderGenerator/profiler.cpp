@@ -0,0 +1,262 @@
+#include "profiler.h"
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#include <malloc.h>
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#include <sys/resource.h>
+#else
+#include <malloc.h>
+#include <sys/resource.h>
+#endif
+
+namespace profile = app::profile;
+
+std::atomic<bool> profile::detail::on{ false };
+
+// ---------------------------------------------------------------
+// allocator hook: sizes come from the allocator, so blocks need no header
+// and the hook is a single branch while profiling is off. Blocks allocated
+// while profiling are remembered, so freeing memory allocated before
+// enable() leaves the live count alone.
+// ---------------------------------------------------------------
+
+namespace {
+    std::atomic<int64_t> live{ 0 };
+    std::atomic<int64_t> peak{ 0 };
+    std::atomic<uint64_t> count{ 0 };
+
+    // align is 0 for blocks from the plain operator new
+    void* raw_alloc(size_t n, size_t align) noexcept {
+        if(!align) return std::malloc(n);
+#ifdef _WIN32
+        return _aligned_malloc(n, align);
+#else
+        void* p = nullptr;
+        return posix_memalign(&p, std::max(align, sizeof(void*)), n) == 0 ? p : nullptr;
+#endif
+    }
+
+    void raw_free(void* p, size_t align) noexcept {
+#ifdef _WIN32
+        if(align) return _aligned_free(p);
+#endif
+        (void)align;
+        std::free(p);
+    }
+
+    size_t block_size(void* p, size_t align) {
+#ifdef _WIN32
+        return align ? _aligned_msize(p, align, 0) : _msize(p);
+#elif defined(__APPLE__)
+        (void)align;
+        return malloc_size(p);
+#else
+        (void)align;
+        return malloc_usable_size(p);
+#endif
+    }
+
+    // The set must not allocate through the hook it serves.
+    template <typename T>
+    struct MallocAllocator {
+        using value_type = T;
+        MallocAllocator() = default;
+        template <typename U> MallocAllocator(const MallocAllocator<U>&) {}
+        T* allocate(size_t n) {
+            if(void* p = std::malloc(n * sizeof(T))) return static_cast<T*>(p);
+            throw std::bad_alloc();
+        }
+        void deallocate(T* p, size_t) { std::free(p); }
+        bool operator==(const MallocAllocator&) const { return true; }
+    };
+
+    // Tracked blocks, sharded by address to keep the locks apart. Never
+    // destroyed, as blocks are freed until the process exits.
+    struct Tracked {
+        std::mutex m;
+        std::unordered_set<void*, std::hash<void*>, std::equal_to<void*>, MallocAllocator<void*>> blocks;
+    };
+    constexpr size_t tracked_shards = 64;
+
+    Tracked& tracked(void* p) {
+        static Tracked* shards = new(std::malloc(sizeof(Tracked) * tracked_shards)) Tracked[tracked_shards];
+        return shards[(uintptr_t(p) >> 4) % tracked_shards];
+    }
+
+    void* counted_alloc(size_t n, size_t align) noexcept {
+        void* p = raw_alloc(n ? n : 1, align);
+        if(p && profile::enabled()) {
+            Tracked& t = tracked(p);
+            try {
+                std::lock_guard<std::mutex> lock(t.m);
+                t.blocks.insert(p);
+            }
+            catch(const std::bad_alloc&) {
+                return p;   // untracked: counted neither way
+            }
+            int64_t size = int64_t(block_size(p, align));
+            int64_t now = live.fetch_add(size, std::memory_order_relaxed) + size;
+            count.fetch_add(1, std::memory_order_relaxed);
+            int64_t old = peak.load(std::memory_order_relaxed);
+            while(now > old && !peak.compare_exchange_weak(old, now, std::memory_order_relaxed)) {}
+        }
+        return p;
+    }
+
+    void* counted_new(size_t n, size_t align) {
+        for(;;) {
+            if(void* p = counted_alloc(n, align)) return p;
+            std::new_handler h = std::get_new_handler();
+            if(!h) throw std::bad_alloc();
+            h();
+        }
+    }
+
+    void counted_free(void* p, size_t align) noexcept {
+        if(!p) return;
+        if(profile::enabled()) {
+            Tracked& t = tracked(p);
+            bool mine;
+            {
+                std::lock_guard<std::mutex> lock(t.m);
+                mine = t.blocks.erase(p) != 0;
+            }
+            if(mine) live.fetch_sub(int64_t(block_size(p, align)), std::memory_order_relaxed);
+        }
+        raw_free(p, align);
+    }
+}
+
+void* operator new(size_t n) { return counted_new(n, 0); }
+void* operator new[](size_t n) { return counted_new(n, 0); }
+void* operator new(size_t n, const std::nothrow_t&) noexcept { return counted_alloc(n, 0); }
+void* operator new[](size_t n, const std::nothrow_t&) noexcept { return counted_alloc(n, 0); }
+void operator delete(void* p) noexcept { counted_free(p, 0); }
+void operator delete[](void* p) noexcept { counted_free(p, 0); }
+void operator delete(void* p, size_t) noexcept { counted_free(p, 0); }
+void operator delete[](void* p, size_t) noexcept { counted_free(p, 0); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { counted_free(p, 0); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { counted_free(p, 0); }
+
+void* operator new(size_t n, std::align_val_t a) { return counted_new(n, size_t(a)); }
+void* operator new[](size_t n, std::align_val_t a) { return counted_new(n, size_t(a)); }
+void* operator new(size_t n, std::align_val_t a, const std::nothrow_t&) noexcept { return counted_alloc(n, size_t(a)); }
+void* operator new[](size_t n, std::align_val_t a, const std::nothrow_t&) noexcept { return counted_alloc(n, size_t(a)); }
+void operator delete(void* p, std::align_val_t a) noexcept { counted_free(p, size_t(a)); }
+void operator delete[](void* p, std::align_val_t a) noexcept { counted_free(p, size_t(a)); }
+void operator delete(void* p, size_t, std::align_val_t a) noexcept { counted_free(p, size_t(a)); }
+void operator delete[](void* p, size_t, std::align_val_t a) noexcept { counted_free(p, size_t(a)); }
+void operator delete(void* p, std::align_val_t a, const std::nothrow_t&) noexcept { counted_free(p, size_t(a)); }
+void operator delete[](void* p, std::align_val_t a, const std::nothrow_t&) noexcept { counted_free(p, size_t(a)); }
+
+// ---------------------------------------------------------------
+
+void profile::enable() { detail::on.store(true); }
+
+int64_t profile::heap_live() { return live.load(std::memory_order_relaxed); }
+int64_t profile::heap_peak() { return peak.load(std::memory_order_relaxed); }
+void profile::set_heap_peak(int64_t bytes) { peak.store(bytes, std::memory_order_relaxed); }
+uint64_t profile::allocations() { return count.load(std::memory_order_relaxed); }
+
+uint64_t profile::peak_rss() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if(!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return 0;
+    return uint64_t(pmc.PeakWorkingSetSize);
+#else
+    rusage ru;
+    if(getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+#ifdef __APPLE__
+    return uint64_t(ru.ru_maxrss);
+#else
+    return uint64_t(ru.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+namespace {
+    struct Record {
+        const char* name;
+        int depth;
+        uint64_t calls = 0, allocs = 0;
+        double seconds = 0.0;
+        int64_t peak_bytes = 0;
+    };
+
+    std::mutex records_m;
+    std::vector<Record> records;
+    thread_local int depth = 0;
+
+    // first scope of a name fixes its row, so parents precede their children
+    Record& record(const char* name, int d) {
+        for(auto& r : records)
+            if(r.name == name || std::string_view(r.name) == name) return r;
+        return records.emplace_back(Record{ name, d });
+    }
+}
+
+// Stage peaks nest: a scope measures from its own start and hands the
+// larger peak back to the scope around it.
+void profile::Scope::begin(const char* n) {
+    name = n;
+    depth = ::depth++;
+    {
+        std::lock_guard<std::mutex> lock(records_m);
+        record(name, depth);
+    }
+    live0 = heap_live();
+    outer_peak = heap_peak();
+    set_heap_peak(live0);
+    allocs0 = allocations();
+    t0 = std::chrono::steady_clock::now();
+}
+
+void profile::Scope::end() {
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    int64_t p = heap_peak();
+    set_heap_peak(std::max(outer_peak, p));
+    --::depth;
+
+    std::lock_guard<std::mutex> lock(records_m);
+    Record& r = record(name, depth);
+    r.calls += 1;
+    r.seconds += s;
+    r.allocs += allocations() - allocs0;
+    r.peak_bytes = std::max(r.peak_bytes, p - live0);
+}
+
+void profile::report(std::FILE* f, bool json) {
+    std::lock_guard<std::mutex> lock(records_m);
+    double mb = 1.0 / (1024.0 * 1024.0);
+    if(json) {
+        std::fprintf(f, "{\"peak_rss_bytes\": %llu, \"stages\": [", (unsigned long long)peak_rss());
+        for(size_t i = 0; i < records.size(); ++i) {
+            const Record& r = records[i];
+            std::fprintf(f, "%s\n  {\"stage\": \"%s\", \"depth\": %d, \"calls\": %llu, \"seconds\": %.6f, "
+                "\"allocations\": %llu, \"peak_heap_bytes\": %lld}",
+                i ? "," : "", r.name, r.depth, (unsigned long long)r.calls, r.seconds,
+                (unsigned long long)r.allocs, (long long)r.peak_bytes);
+        }
+        std::fprintf(f, "\n]}\n");
+        return;
+    }
+
+    int w = 5;
+    for(const auto& r : records) w = std::max(w, 2 * r.depth + int(std::string_view(r.name).size()));
+    std::fprintf(f, "%-*s %6s %10s %12s %12s\n", w, "stage", "calls", "ms", "allocs", "peak MiB");
+    for(const auto& r : records)
+        std::fprintf(f, "%*s%-*s %6llu %10.2f %12llu %12.2f\n", 2 * r.depth, "", w - 2 * r.depth, r.name,
+            (unsigned long long)r.calls, r.seconds * 1e3, (unsigned long long)r.allocs, double(r.peak_bytes) * mb);
+    std::fprintf(f, "peak RSS %.1f MiB\n", double(peak_rss()) * mb);
+}
\ No newline at end of file
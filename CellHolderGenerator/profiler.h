@@ -0,0 +1,56 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+// Stage profiler. Scopes record wall time, heap allocations and the heap
+// peak per stage name; report() adds the process peak RSS. While disabled a
+// Scope is one flag test and the allocator hook adds nothing to new/delete.
+namespace app::profile {
+    namespace detail {
+        extern std::atomic<bool> on;
+    }
+
+    inline bool enabled() { return detail::on.load(std::memory_order_relaxed); }
+    void enable();
+
+    // Heap bytes currently live / highest live since set_heap_peak, counted
+    // by the global operator new, aligned or not, for blocks allocated while
+    // profiling is enabled.
+    int64_t heap_live();
+    int64_t heap_peak();
+    void set_heap_peak(int64_t bytes);
+    uint64_t allocations();
+
+    // Peak resident set size of the process in bytes, 0 if unknown.
+    uint64_t peak_rss();
+
+    // Times the enclosing block under name, which must be a string literal
+    // or otherwise outlive the report. Repeated scopes of the same name add up.
+    class Scope {
+    public:
+        explicit Scope(const char* name) {
+            if(enabled()) begin(name);
+        }
+        ~Scope() {
+            if(name) end();
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        void begin(const char* name);
+        void end();
+
+        const char* name = nullptr;
+        std::chrono::steady_clock::time_point t0;
+        uint64_t allocs0 = 0;
+        int64_t live0 = 0, outer_peak = 0;
+        int depth = 0;
+    };
+
+    // Writes the recorded stages as an aligned table or as JSON.
+    void report(std::FILE* f, bool json);
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "vec2.h"
+
+namespace geometry {
+    // All rings of a cross-section in one coordinate buffer. Ring i occupies
+    // pts[offsets[i], offsets[i + 1]); ring 0 is the outer boundary.
+    struct RingSet {
+        std::vector<Vec2> pts;
+        std::vector<uint32_t> offsets{ 0 };
+
+        size_t size() const { return offsets.size() - 1; }
+        bool empty() const { return size() == 0; }
+        uint32_t start(size_t i) const { return offsets[i]; }
+        uint32_t count(size_t i) const { return offsets[i + 1] - offsets[i]; }
+
+        std::span<const Vec2> operator[](size_t i) const { return { pts.data() + offsets[i], count(i) }; }
+        std::span<Vec2> operator[](size_t i) { return { pts.data() + offsets[i], count(i) }; }
+
+        void reserve(size_t rings, size_t points) { offsets.reserve(rings + 1); pts.reserve(points); }
+
+        // Closes the ring made of the points appended to pts since the last one.
+        void end_ring() { offsets.push_back(uint32_t(pts.size())); }
+        void add_ring(std::span<const Vec2> ring) { pts.insert(pts.end(), ring.begin(), ring.end()); end_ring(); }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,505 @@
+#include "server.h"
+#include "parameters.h"
+#include "pipeline.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#endif
+
+using app::Server;
+
+struct Server::Session {
+    std::mutex m;           // held while the pipeline runs
+    Pipeline pipeline;
+    std::mutex params_m;    // guards params and latest
+    Parameters params;
+    std::atomic<uint64_t> latest{ 0 };
+    std::string dir;        // relative outputs go here
+
+    Session(const Cache* cache, std::string dir) : pipeline(cache), dir(std::move(dir)) {}
+};
+
+// ---------------------------------------------------------------
+// minimal JSON: one object per line, values kept as their text
+// ---------------------------------------------------------------
+
+namespace {
+    struct Value {
+        enum Kind { Null, Bool, Number, String, Object, Array } kind = Null;
+        std::string text;                               // scalars; strings unescaped
+        std::vector<std::pair<std::string, Value>> members;
+
+        const Value* get(std::string_view key) const {
+            for(const auto& [k, v] : members)
+                if(k == key) return &v;
+            return nullptr;
+        }
+    };
+
+    class Parser {
+    public:
+        explicit Parser(std::string_view s) : s(s) {}
+
+        bool document(Value& v) {
+            if(!value(v, 0)) return false;
+            skip();
+            return at == s.size();
+        }
+
+    private:
+        void skip() { while(at < s.size() && (s[at] == ' ' || s[at] == '\t' || s[at] == '\r' || s[at] == '\n')) ++at; }
+        bool eat(char c) { skip(); if(at < s.size() && s[at] == c) { ++at; return true; } return false; }
+
+        bool hex4(unsigned& cp) {
+            if(s.size() - at < 4) return false;
+            cp = 0;
+            auto r = std::from_chars(s.data() + at, s.data() + at + 4, cp, 16);
+            if(r.ptr != s.data() + at + 4) return false;
+            at += 4;
+            return true;
+        }
+
+        // -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+        static bool number(std::string_view t) {
+            size_t i = 0;
+            auto digits = [&] {
+                size_t b = i;
+                while(i < t.size() && t[i] >= '0' && t[i] <= '9') ++i;
+                return i > b;
+            };
+            if(i < t.size() && t[i] == '-') ++i;
+            if(i < t.size() && t[i] == '0') ++i;
+            else if(!digits()) return false;
+            if(i < t.size() && t[i] == '.') {
+                ++i;
+                if(!digits()) return false;
+            }
+            if(i < t.size() && (t[i] == 'e' || t[i] == 'E')) {
+                ++i;
+                if(i < t.size() && (t[i] == '+' || t[i] == '-')) ++i;
+                if(!digits()) return false;
+            }
+            return i == t.size();
+        }
+
+        bool string(std::string& out) {
+            if(!eat('"')) return false;
+            while(at < s.size() && s[at] != '"') {
+                char c = s[at++];
+                if(c != '\\') { out += c; continue; }
+                if(at >= s.size()) return false;
+                switch(char e = s[at++]) {
+                case 'n': out += '\n'; break;
+                case 't': out += '\t'; break;
+                case 'r': out += '\r'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'u': {
+                    unsigned cp;
+                    if(!hex4(cp) || (cp >= 0xDC00 && cp < 0xE000)) return false;
+                    // a high surrogate must be followed by an escaped low one
+                    if(cp >= 0xD800 && cp < 0xDC00) {
+                        unsigned lo;
+                        if(s.substr(at, 2) != "\\u") return false;
+                        at += 2;
+                        if(!hex4(lo) || lo < 0xDC00 || lo >= 0xE000) return false;
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                    }
+                    if(cp < 0x80) out += char(cp);
+                    else if(cp < 0x800) { out += char(0xC0 | (cp >> 6)); out += char(0x80 | (cp & 0x3F)); }
+                    else if(cp < 0x10000) { out += char(0xE0 | (cp >> 12)); out += char(0x80 | ((cp >> 6) & 0x3F)); out += char(0x80 | (cp & 0x3F)); }
+                    else {
+                        out += char(0xF0 | (cp >> 18)); out += char(0x80 | ((cp >> 12) & 0x3F));
+                        out += char(0x80 | ((cp >> 6) & 0x3F)); out += char(0x80 | (cp & 0x3F));
+                    }
+                    break;
+                }
+                case '"': case '\\': case '/': out += e; break;
+                default: return false;
+                }
+            }
+            if(at >= s.size()) return false;
+            ++at;
+            return true;
+        }
+
+        bool value(Value& v, int depth) {
+            skip();
+            if(at >= s.size() || depth > 16) return false;
+            char c = s[at];
+            if(c == '"') { v.kind = Value::String; return string(v.text); }
+            if(c == '{' || c == '[') {
+                bool obj = c == '{';
+                v.kind = obj ? Value::Object : Value::Array;
+                ++at;
+                if(eat(obj ? '}' : ']')) return true;
+                do {
+                    std::pair<std::string, Value> m;
+                    if(obj && (!string(m.first) || !eat(':'))) return false;
+                    if(!value(m.second, depth + 1)) return false;
+                    v.members.push_back(std::move(m));
+                } while(eat(','));
+                return eat(obj ? '}' : ']');
+            }
+            size_t b = at;
+            while(at < s.size() && std::string_view(",}] \t\r\n").find(s[at]) == std::string_view::npos) ++at;
+            v.text = std::string(s.substr(b, at - b));
+            if(v.text == "true" || v.text == "false") v.kind = Value::Bool;
+            else if(v.text == "null") v.kind = Value::Null;
+            else if(number(v.text)) v.kind = Value::Number;
+            else return false;
+            return true;
+        }
+
+        std::string_view s;
+        size_t at = 0;
+    };
+
+    void put_string(std::string& out, std::string_view s) {
+        out += '"';
+        for(char c : s) {
+            if(c == '"' || c == '\\') { out += '\\'; out += c; }
+            else if(c == '\n') out += "\\n";
+            else if(static_cast<unsigned char>(c) < 0x20) {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", unsigned(c));
+                out += buf;
+            }
+            else out += c;
+        }
+        out += '"';
+    }
+
+    // Reply builder: {"id": <id>, "ok": <ok>, ...}
+    class Reply {
+    public:
+        Reply(const Value* id, bool ok) {
+            out = "{\"id\": ";
+            if(!id) out += "null";
+            else if(id->kind == Value::String) put_string(out, id->text);
+            else out += id->text;
+            out += ok ? ", \"ok\": true" : ", \"ok\": false";
+        }
+        Reply& field(const char* key, std::string_view s) { name(key); put_string(out, s); return *this; }
+        Reply& field(const char* key, const char* s) { return field(key, std::string_view(s)); }
+        Reply& field(const char* key, bool b) { name(key); out += b ? "true" : "false"; return *this; }
+        Reply& field(const char* key, int v) { name(key); out += std::to_string(v); return *this; }
+        Reply& field(const char* key, double v) {
+            name(key);
+            char buf[32];
+            std::snprintf(buf, sizeof(buf), "%.6g", v);
+            out += buf;
+            return *this;
+        }
+        Reply& raw(const char* key, const std::string& json) { name(key); out += json; return *this; }
+        std::string str() const { return out + "}"; }
+
+    private:
+        void name(const char* key) { out += ", \""; out += key; out += "\": "; }
+        std::string out;
+    };
+
+    // Applies an object of settings; returns the first key that was rejected.
+    bool apply(app::Parameters& p, const Value* params, std::string& bad) {
+        if(!params) return true;
+        if(params->kind != Value::Object) { bad = "params"; return false; }
+        for(const auto& [k, v] : params->members) {
+            if((v.kind != Value::String && v.kind != Value::Number && v.kind != Value::Bool) || !p.set(k, v.text)) {
+                bad = k;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Paths from clients must stay inside the session directory: relative
+    // and without "..".
+    bool confined(const std::string& path) {
+        std::filesystem::path p(path);
+        if(p.has_root_name() || p.has_root_directory()) return false;
+        for(const auto& part : p)
+            if(part == "..") return false;
+        return true;
+    }
+
+    // First path setting of p that leaves the session directory, or null.
+    const char* escaping_path(const app::Parameters& p) {
+        const std::pair<const char*, const std::string*> paths[] = {
+            { "stl", &p.stl_path }, { "3mf", &p.threemf_path }, { "dxf", &p.dxf_path },
+            { "gcode", &p.gcode_path }, { "plate_dxf", &p.plate_dxf_path }, { "outline_dxf", &p.outline_dxf },
+        };
+        for(const auto& [key, path] : paths)
+            if(!confined(*path)) return key;
+        return nullptr;
+    }
+
+    // Session names become directory names.
+    bool plain_name(std::string_view name) {
+        return !name.empty() && name != "." && name != ".."
+            && name.find_first_of("/\\:") == std::string_view::npos;
+    }
+}
+
+// ---------------------------------------------------------------
+
+// a few workers even on one core, so one long export cannot hold up others
+Server::Server(const Cache* cache, std::string out_dir)
+    : cache(cache), out_dir(std::move(out_dir)), requests(std::max(4u, std::thread::hardware_concurrency()) + 1) {}
+
+Server::~Server() { drain(); }
+
+void Server::drain() {
+    std::unique_lock<std::mutex> lock(inflight_m);
+    inflight_cv.wait(lock, [this] { return inflight == 0; });
+}
+
+std::shared_ptr<Server::Session> Server::session(const std::string& name) {
+    std::lock_guard<std::mutex> lock(sessions_m);
+    auto& s = sessions[name];
+    if(!s) s = std::make_shared<Session>(cache, (std::filesystem::path(out_dir) / name).string());
+    return s;
+}
+
+void Server::handle(const std::string& line, std::function<void(const std::string&)> reply) {
+    Value req;
+    if(!Parser(line).document(req) || req.kind != Value::Object) {
+        reply(Reply(nullptr, false).field("error", "malformed request").str());
+        return;
+    }
+    const Value* id = req.get("id");
+    const Value* op = req.get("op");
+    const Value* name = req.get("session");
+    std::string op_name = op ? op->text : "";
+    std::string session_name = name ? name->text : "default";
+    std::string bad;
+
+    if(op_name == "fit") {
+        Parameters p;
+        if(!apply(p, req.get("params"), bad)) {
+            reply(Reply(id, false).field("error", "bad setting").field("key", bad).str());
+            return;
+        }
+        if(const char* key = escaping_path(p)) {
+            reply(Reply(id, false).field("error", "path outside the session directory").field("key", key).str());
+            return;
+        }
+        if(!p.outline_dxf.empty()) {
+            if(!plain_name(session_name)) {
+                reply(Reply(id, false).field("error", "bad session").str());
+                return;
+            }
+            p.outline_dxf = (std::filesystem::path(out_dir) / session_name / p.outline_dxf).string();
+        }
+        // the pipeline's own fit stage, so outlines are packed as generate would
+        Pipeline scratch;
+        if(!scratch.update_fit(p)) {
+            reply(Reply(id, false).field("error", "cannot fit").str());
+            return;
+        }
+        const auto& fit = scratch.fit();
+        Reply r(id, true);
+        r.field("fits", fit.fits);
+        if(scratch.packed_outline())
+            r.field("cells", int(scratch.packed_cells()));
+        else
+            r.field("maxSeries", fit.maxSeries).field("maxParallel", fit.maxParallel)
+                .field("reqWidth", double(fit.reqWidth)).field("reqHeight", double(fit.reqHeight))
+                .field("deltaWidth", double(fit.deltaWidth)).field("deltaHeight", double(fit.deltaHeight));
+        reply(r.str());
+        return;
+    }
+
+    if(op_name == "close") {
+        std::lock_guard<std::mutex> lock(sessions_m);
+        bool found = sessions.erase(session_name) > 0;
+        reply(Reply(id, found).str());
+        return;
+    }
+
+    if(op_name != "generate") {
+        reply(Reply(id, false).field("error", "unknown op").str());
+        return;
+    }
+    if(!plain_name(session_name)) {
+        reply(Reply(id, false).field("error", "bad session").str());
+        return;
+    }
+
+    // Settings apply here, in arrival order, and each task gets its own
+    // snapshot; the task only runs if no newer request has arrived since.
+    auto s = session(session_name);
+    auto next = std::make_shared<Parameters>();
+    uint64_t seq;
+    {
+        std::lock_guard<std::mutex> lock(s->params_m);
+        Parameters p = s->params;
+        if(!apply(p, req.get("params"), bad)) {
+            reply(Reply(id, false).field("error", "bad setting").field("key", bad).str());
+            return;
+        }
+        if(const char* key = escaping_path(p)) {
+            reply(Reply(id, false).field("error", "path outside the session directory").field("key", key).str());
+            return;
+        }
+        s->params = p;
+        *next = std::move(p);
+        next->relocate(s->dir);
+        if(!next->outline_dxf.empty()) next->outline_dxf = (std::filesystem::path(s->dir) / next->outline_dxf).string();
+        seq = ++s->latest;
+    }
+    auto id_copy = id ? std::make_shared<const Value>(*id) : nullptr;
+    {
+        std::lock_guard<std::mutex> lock(inflight_m);
+        ++inflight;
+    }
+    requests.submit([this, s, seq, next, id_copy, reply = std::move(reply)] {
+        const Value* id = id_copy.get();
+        {
+            std::lock_guard<std::mutex> lock(s->m);
+            if(seq != s->latest.load())
+                reply(Reply(id, false).field("superseded", true).str());
+            else {
+                auto t0 = std::chrono::steady_clock::now();
+                std::error_code ec;
+                std::filesystem::create_directories(s->dir, ec);
+                bool ok = !ec && s->pipeline.update(*next);
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+                std::string ran = "[";
+                for(const char* n : s->pipeline.recomputed()) {
+                    if(ran.size() > 1) ran += ", ";
+                    put_string(ran, n);
+                }
+                ran += "]";
+                Reply r(id, ok);
+                r.field("fits", s->pipeline.fit().fits).field("ms", ms).raw("recomputed", ran)
+                    .field("stl", next->stl_path).field("dxf", next->dxf_path);
+                if(next->export_3mf) r.field("3mf", next->threemf_path);
+                if(!next->gcode_path.empty()) r.field("gcode", next->gcode_path);
+                if(!next->plate_dxf_path.empty()) r.field("plate_dxf", next->plate_dxf_path);
+                reply(r.str());
+            }
+        }
+        std::lock_guard<std::mutex> lock(inflight_m);
+        if(--inflight == 0) inflight_cv.notify_all();
+    });
+}
+
+void Server::serve_stream(std::FILE* in, std::FILE* out) {
+    auto out_m = std::make_shared<std::mutex>();
+    auto reply = [out, out_m](const std::string& r) {
+        std::lock_guard<std::mutex> lock(*out_m);
+        std::fwrite(r.data(), 1, r.size(), out);
+        std::fputc('\n', out);
+        std::fflush(out);
+    };
+
+    std::string line;
+    for(int c; (c = std::fgetc(in)) != EOF;) {
+        if(c != '\n') { line += char(c); continue; }
+        if(line.find_first_not_of(" \t\r") != std::string::npos) handle(line, reply);
+        line.clear();
+    }
+    if(line.find_first_not_of(" \t\r") != std::string::npos) handle(line, reply);
+    drain();
+}
+
+#ifdef _WIN32
+bool Server::serve_socket(const char*) { return false; }
+#else
+bool Server::serve_socket(const char* path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if(std::string_view(path).size() >= sizeof(addr.sun_path)) return false;
+    std::snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0) return false;
+    ::unlink(path);
+    if(::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(fd, 16) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    // one reader per client; replies may come from pool threads, so every
+    // client has its own write lock and its socket closes with the last reply
+    struct Client {
+        int fd;
+        std::mutex m;
+        std::atomic<bool> done{ false };
+        ~Client() { ::close(fd); }
+    };
+    // readers are joined once their client hangs up, and all of them before
+    // returning, since they call back into this server
+    std::vector<std::pair<std::shared_ptr<Client>, std::thread>> readers;
+    auto reap = [&readers] {
+        for(auto it = readers.begin(); it != readers.end();) {
+            if(!it->first->done) { ++it; continue; }
+            it->second.join();
+            it = readers.erase(it);
+        }
+    };
+    for(;;) {
+        int cfd = ::accept(fd, nullptr, nullptr);
+        if(cfd < 0) {
+            // a signal or a client that gave up is no reason to stop; out
+            // of descriptors or memory, wait for readers to finish first
+            if(errno == EINTR || errno == ECONNABORTED || errno == EAGAIN || errno == EWOULDBLOCK || errno == EPROTO)
+                continue;
+            if(errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                reap();
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                continue;
+            }
+            break;
+        }
+        reap();
+        auto client = std::make_shared<Client>();
+        client->fd = cfd;
+        readers.emplace_back(client, std::thread([this, client] {
+            auto reply = [client](const std::string& r) {
+                std::lock_guard<std::mutex> lock(client->m);
+                std::string msg = r + "\n";
+                for(size_t at = 0; at < msg.size();) {
+                    ssize_t n = ::send(client->fd, msg.data() + at, msg.size() - at, MSG_NOSIGNAL);
+                    if(n <= 0) return;
+                    at += size_t(n);
+                }
+            };
+            std::string line;
+            char buf[4096];
+            for(ssize_t n; (n = ::recv(client->fd, buf, sizeof(buf), 0)) > 0;) {
+                for(ssize_t i = 0; i < n; ++i) {
+                    if(buf[i] != '\n') { line += buf[i]; continue; }
+                    if(line.find_first_not_of(" \t\r") != std::string::npos) handle(line, reply);
+                    line.clear();
+                }
+            }
+            client->done = true;
+        }));
+    }
+    // stop reading from clients still connected; pending replies still go out
+    for(auto& [client, reader] : readers) {
+        ::shutdown(client->fd, SHUT_RD);
+        reader.join();
+    }
+    ::close(fd);
+    drain();
+    return true;
+}
+#endif
@@ -0,0 +1,75 @@
+#pragma once
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "thread_pool.h"
+
+namespace app {
+    class Cache;
+
+    // Long-running generator answering JSON-lines requests, one object per
+    // line:
+    //
+    //   {"id": 1, "op": "fit", "params": {"series": 10, "parallel": 4}}
+    //   {"id": 2, "op": "generate", "session": "plugin-a", "params": {"wall_height": 12}}
+    //   {"id": 3, "op": "close", "session": "plugin-a"}
+    //
+    // params uses the Parameters keys. fit runs the fit stage of a Pipeline
+    // on the reading thread, so an outline is packed exactly as generate
+    // would, and answers with the cells it holds instead of the rectangle's
+    // maxSeries, maxParallel and required size. generate applies params on top of the session's last
+    // settings and updates the session's Pipeline, so unchanged stages, the
+    // triangulator pools and the disk cache stay warm across edits. Paths
+    // in params (the outputs and outline_dxf) must be relative and free of
+    // "..", and are taken inside a directory of the session's own,
+    // out_dir/<session>, so clients never reach other sessions' files or
+    // any outside it; a session name must therefore be a plain file name.
+    // Generate requests run on the server's own worker threads, so a reader
+    // never waits on an export and sessions proceed concurrently. A request
+    // overtaken by a newer one of the same session before it starts is
+    // answered "superseded", so slider drags only pay for the latest
+    // position. Every reply carries the id.
+    class Server {
+    public:
+        explicit Server(const Cache* cache = nullptr, std::string out_dir = ".");
+        ~Server();
+
+        Server(const Server&) = delete;
+        Server& operator=(const Server&) = delete;
+
+        // Handles one request line. reply is called exactly once with the
+        // response line (no newline), possibly later and on another thread.
+        void handle(const std::string& line, std::function<void(const std::string&)> reply);
+
+        // Serves requests read from in until EOF, replies go to out.
+        void serve_stream(std::FILE* in, std::FILE* out);
+
+        // Listens on a Unix domain socket at path with one reader per client.
+        // Interrupted or aborted accepts are retried, and running out of
+        // descriptors waits for clients to leave; only an error of the
+        // socket itself ends it. Returns false if the socket cannot be set
+        // up or on Windows.
+        bool serve_socket(const char* path);
+
+        // Blocks until every accepted request has been answered.
+        void drain();
+
+    private:
+        struct Session;
+        std::shared_ptr<Session> session(const std::string& name);
+
+        const Cache* cache;
+        std::string out_dir;
+        std::mutex sessions_m;
+        std::map<std::string, std::shared_ptr<Session>> sessions;
+
+        ThreadPool requests;
+        std::mutex inflight_m;
+        std::condition_variable inflight_cv;
+        size_t inflight = 0;
+    };
+}
@@ -1,40 +1,110 @@
-#include <windows.h>
-#include <string>
-#include <fstream>
+#include <cstring>
 #include "stl_exporter.h"
+#include "profiler.h"
 
-void STLExporter::export_ascii(const Mesh& mesh, const char* filename) {
-    char buffer[MAX_PATH];
-    GetModuleFileNameA(nullptr, buffer, MAX_PATH);
-    std::string exePath(buffer);
-    auto pos = exePath.find_last_of("\\/");
-    std::string dir = pos != std::string::npos
-        ? exePath.substr(0, pos + 1)
-        : "";
+using geometry::Triangle;
 
-    std::string outPath = dir + filename;
-    std::ofstream out(outPath, std::ios::out);
-    out << "solid cellholder\n";
+static inline bool face_in_range(const Face& f, size_t V) {
+    return (uint32_t)f.v1 < V && (uint32_t)f.v2 < V && (uint32_t)f.v3 < V;
+}
 
+// De-indexes the valid faces of mesh into bounded triangle batches.
+static void stream_mesh(const Mesh& mesh, geometry::TriangleSink& sink) {
+    const size_t batch = 4096;
+    std::vector<Triangle> buf;
+    buf.reserve(batch);
     auto V = mesh.vertices.size();
     for(const auto& f : mesh.faces) {
-        if((uint32_t)f.v1 >= V || (uint32_t)f.v2 >= V || (uint32_t)f.v3 >= V)
+        if(!face_in_range(f, V))
             continue;
+        buf.push_back({ mesh.vertices[f.v1], mesh.vertices[f.v2], mesh.vertices[f.v3] });
+        if(buf.size() == batch) { sink.consume(buf.data(), buf.size()); buf.clear(); }
+    }
+    if(!buf.empty()) sink.consume(buf.data(), buf.size());
+}
+
+bool STLExporter::export_ascii(const Mesh& mesh, const char* path) {
+    app::profile::Scope scope("export_ascii");
+    AsciiWriter w(path);
+    stream_mesh(mesh, w);
+    return w.close();
+}
+
+bool STLExporter::export_binary(const Mesh& mesh, const char* path) {
+    app::profile::Scope scope("export_binary");
+    auto V = mesh.vertices.size();
+    uint32_t count = 0;
+    for(const auto& f : mesh.faces)
+        if(face_in_range(f, V)) ++count;
+
+    BinaryWriter w(path, count);
+    stream_mesh(mesh, w);
+    return w.close();
+}
+
+STLExporter::AsciiWriter::AsciiWriter(const char* path) : sink(path) {
+    out.put("solid cellholder\n");
+}
+
+void STLExporter::AsciiWriter::consume(const Triangle* tris, size_t n) {
+    app::profile::Scope scope("stl_write");
+    text::format_parallel(out, n, [&](text::Buffer& o, size_t i) {
+        const Vec3& a = tris[i].a;
+        const Vec3& b = tris[i].b;
+        const Vec3& c = tris[i].c;
+        Vec3 nrm = (b - a).cross(c - a).normalize();
+
+        o.put("  facet normal "); o.put(nrm.x); o.put(' '); o.put(nrm.y); o.put(' '); o.put(nrm.z);
+        o.put("\n    outer loop\n");
+        for(const Vec3* v : { &a, &b, &c }) {
+            o.put("      vertex "); o.put(v->x); o.put(' '); o.put(v->y); o.put(' '); o.put(v->z); o.put('\n');
+        }
+        o.put("    endloop\n  endfacet\n");
+        }, 1024);
+    sink.write(out.data(), out.size());
+    out.clear();
+}
+
+bool STLExporter::AsciiWriter::close() {
+    out.put("endsolid cellholder\n");
+    sink.write(out.data(), out.size());
+    out.clear();
+    return sink.close();
+}
+
+// 80-byte header, uint32 facet count, then 50 bytes per facet:
+// normal + 3 vertices as little-endian float32 and a zero uint16 attribute.
+STLExporter::BinaryWriter::BinaryWriter(const char* path, uint32_t count)
+    : sink(path, 84 + size_t(count) * 50), count(count) {
+    if(!sink.ok()) return;
+    char header[84] = "binary stl cellholder";
+    std::memcpy(header + 80, &count, 4);
+    sink.write(header, sizeof(header));
+}
+
+void STLExporter::BinaryWriter::consume(const Triangle* tris, size_t n) {
+    app::profile::Scope scope("stl_write");
+    if(!sink.ok()) return;
+    if(n > count - written) {
+        sink.fail();
+        return;
+    }
+    char* p = sink.map();
+    for(size_t i = 0; i < n; ++i, p += 50) {
+        const Vec3& a = tris[i].a;
+        const Vec3& b = tris[i].b;
+        const Vec3& c = tris[i].c;
+        Vec3 nrm = (b - a).cross(c - a).normalize();
 
-        auto a = mesh.vertices[f.v1];
-        auto b = mesh.vertices[f.v2];
-        auto c = mesh.vertices[f.v3];
-        auto n = (b - a).cross(c - a).normalize();
-
-        out << "  facet normal " << n.x << " " << n.y << " " << n.z << "\n"
-            << "    outer loop\n"
-            << "      vertex " << a.x << " " << a.y << " " << a.z << "\n"
-            << "      vertex " << b.x << " " << b.y << " " << b.z << "\n"
-            << "      vertex " << c.x << " " << c.y << " " << c.z << "\n"
-            << "    endloop\n"
-            << "  endfacet\n";
+        float rec[12] = { nrm.x, nrm.y, nrm.z, a.x, a.y, a.z, b.x, b.y, b.z, c.x, c.y, c.z };
+        std::memcpy(p, rec, sizeof(rec));
+        std::memset(p + 48, 0, 2);
     }
+    sink.commit(n * 50);
+    written += uint32_t(n);
+}
 
-    out << "endsolid cellholder\n";
-    out.close();
+bool STLExporter::BinaryWriter::close() {
+    if(written != count) sink.fail();
+    return sink.close();
 }
\ No newline at end of file
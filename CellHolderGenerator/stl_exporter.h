@@ -1,7 +1,40 @@
 #pragma once
+#include <cstdint>
+#include "extrusion.h"
 #include "mesh.h"
+#include "output_sink.h"
+#include "text_format.h"
 
 class STLExporter {
 public:
-    static void export_ascii(const Mesh& mesh, const char* filename);
+    static bool export_ascii(const Mesh& mesh, const char* path);
+    static bool export_binary(const Mesh& mesh, const char* path);
+
+    // Streaming writers fed directly by geometry::extrude, so the caller never
+    // has to materialize a Mesh.
+    class AsciiWriter : public geometry::TriangleSink {
+    public:
+        explicit AsciiWriter(const char* path);
+        void consume(const geometry::Triangle* tris, size_t n) override;
+        bool close();
+
+    private:
+        io::StreamSink sink;
+        text::Buffer out;
+    };
+
+    // count is the exact number of facets that will be consumed; the file is
+    // mapped at its final size up front. More facets than that, or fewer by
+    // close(), make close() fail and leave the old file alone.
+    class BinaryWriter : public geometry::TriangleSink {
+    public:
+        BinaryWriter(const char* path, uint32_t count);
+        void consume(const geometry::Triangle* tris, size_t n) override;
+        bool close();
+
+    private:
+        io::MappedSink sink;
+        uint32_t count;
+        uint32_t written = 0;
+    };
 };
\ No newline at end of file
@@ -0,0 +1,75 @@
+#include "sweep.h"
+#include "cell_layout.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cmath>
+
+using app::Candidate;
+
+void Candidate::apply(Parameters& p) const {
+    if(rotated) std::swap(p.width, p.height);
+    p.spacing = spacing;
+    p.honeycomb = honeycomb;
+    p.series = series;
+    p.parallel = parallel;
+}
+
+std::vector<Candidate> app::sweep(const SweepSpec& spec) {
+    int steps = 1;
+    if(spec.spacing_step > 0.0f && spec.spacing_max > spec.spacing_min)
+        steps += int(std::floor((spec.spacing_max - spec.spacing_min) / spec.spacing_step + 1e-4f));
+
+    // one slot per (lattice, orientation, spacing), filled in parallel
+    const int unbounded = 1 << 20;
+    std::vector<std::vector<Candidate>> slots(size_t(4) * size_t(steps));
+    ThreadPool::shared().parallel_for(slots.size(), [&](size_t k) {
+        bool honeycomb = (k & 1) != 0;
+        bool rotated = (k & 2) != 0;
+        float spacing = spec.spacing_min + float(k >> 2) * spec.spacing_step;
+        float W = rotated ? spec.height : spec.width;
+        float H = rotated ? spec.width : spec.height;
+
+        // rows and columns are independent, so the most of each that fit
+        // bound every split
+        auto most = CellLayout::fitRect(W, H, spec.cell_dia, spacing,
+            spec.wall_thickness, unbounded, unbounded, honeycomb);
+        if(most.maxSeries <= 0 || most.maxParallel <= 0) return;
+
+        auto& out = slots[k];
+        int first_rows = spec.all_rows ? 1 : most.maxParallel;
+        out.reserve(size_t(most.maxSeries) * size_t(most.maxParallel - first_rows + 1));
+        for(int s = 1; s <= most.maxSeries; ++s)
+            for(int rows = first_rows; rows <= most.maxParallel; ++rows) {
+                auto fit = CellLayout::fitRect(W, H, spec.cell_dia, spacing,
+                    spec.wall_thickness, s, rows, honeycomb);
+                if(!fit.fits) continue;
+                bool meets = (spec.target_series == 0 || s == spec.target_series)
+                    && rows >= spec.min_parallel;
+                out.push_back({ honeycomb, rotated, spacing, s, rows,
+                    fit.reqWidth, fit.reqHeight,
+                    std::min(W - fit.reqWidth, H - fit.reqHeight), meets });
+            }
+    });
+
+    std::vector<Candidate> all;
+    size_t total = 0;
+    for(const auto& s : slots) total += s.size();
+    all.reserve(total);
+    for(const auto& s : slots) all.insert(all.end(), s.begin(), s.end());
+
+    auto better = [](const Candidate& a, const Candidate& b) {
+        if(a.meets_target != b.meets_target) return a.meets_target;
+        if(a.cells() != b.cells()) return a.cells() > b.cells();
+        if(a.slack != b.slack) return a.slack > b.slack;
+        if(a.series != b.series) return a.series > b.series;
+        if(a.spacing != b.spacing) return a.spacing < b.spacing;
+        if(a.honeycomb != b.honeycomb) return b.honeycomb;
+        return !a.rotated && b.rotated;
+    };
+    if(spec.max_results && spec.max_results < all.size()) {
+        std::partial_sort(all.begin(), all.begin() + spec.max_results, all.end(), better);
+        all.resize(spec.max_results);
+    }
+    else std::sort(all.begin(), all.end(), better);
+    return all;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <vector>
+#include "parameters.h"
+
+namespace app {
+    // Enclosure, cell and the design space to search. Series count sets the
+    // pack voltage and parallel count its capacity; 0 leaves a target open.
+    struct SweepSpec {
+        float width = 0.0f;
+        float height = 0.0f;
+        float cell_dia = 21.4f;
+        float wall_thickness = 0.5f;
+        float spacing_min = 0.5f;
+        float spacing_max = 0.5f;
+        float spacing_step = 0.1f;
+        int   target_series = 0;
+        int   min_parallel = 0;
+        bool  all_rows = false; // every row count that fits, not only the most
+        size_t max_results = 0; // 0 keeps every candidate
+    };
+
+    // One fitting pack: series cells along the plate width, parallel rows
+    // along its height, with the plate turned 90 degrees in the enclosure
+    // if rotated is set.
+    struct Candidate {
+        bool  honeycomb;
+        bool  rotated;
+        float spacing;
+        int   series;
+        int   parallel;
+        float reqWidth;
+        float reqHeight;
+        float slack;        // smaller of the width and height margins, mm
+        bool  meets_target;
+
+        int cells() const { return series * parallel; }
+
+        // Copies the candidate's layout into p, swapping width and height
+        // when rotated, so Application::run builds exactly this pack.
+        void apply(Parameters& p) const;
+    };
+
+    // Evaluates every lattice type, orientation, spacing step and series
+    // count with the closed-form CellLayout::fitRect math, in parallel on the
+    // shared pool, taking the most parallel rows that fit for each, or every
+    // row count that fits with all_rows. No rings or meshes are built. Results are ranked: target matches first, then
+    // most cells, then most slack.
+    std::vector<Candidate> sweep(const SweepSpec& spec);
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+
+namespace geometry {
+    // Segments for a full circle of radius R whose chords stay within e of
+    // the arc, rounded up to a multiple of four. Arcs take the share of
+    // their sweep.
+    inline int segs_from_tol(float R, float e, int min_segs = 64, int max_segs = 4096) {
+        if(R <= 0.f) return min_segs;
+        double ee = std::max(1e-6, double(e));
+        double th = 2.0 * std::acos(std::max(0.0, 1.0 - ee / double(R)));
+        if(!std::isfinite(th) || th <= 0.0) return max_segs;
+        int n = int(std::ceil((2.0 * M_PI) / th));
+        n = (n + 3) & ~3;
+        return std::min(std::max(n, min_segs), max_segs);
+    }
+}
@@ -0,0 +1,40 @@
+#include "text_format.h"
+#include <charconv>
+
+using text::Buffer;
+
+void Buffer::put(float v) {
+    grow(32);
+    auto r = std::to_chars(bytes.data() + len, bytes.data() + bytes.size(), v, std::chars_format::general, 6);
+    len = size_t(r.ptr - bytes.data());
+}
+
+void Buffer::put(int v) {
+    grow(16);
+    auto r = std::to_chars(bytes.data() + len, bytes.data() + bytes.size(), v);
+    len = size_t(r.ptr - bytes.data());
+}
+
+void Buffer::put(uint32_t v) {
+    grow(16);
+    auto r = std::to_chars(bytes.data() + len, bytes.data() + bytes.size(), v);
+    len = size_t(r.ptr - bytes.data());
+}
+
+void Buffer::put_exact(float v) {
+    grow(32);
+    auto r = std::to_chars(bytes.data() + len, bytes.data() + bytes.size(), v);
+    len = size_t(r.ptr - bytes.data());
+}
+
+void Buffer::put_fixed(float v, int decimals) {
+    grow(64);
+    auto r = std::to_chars(bytes.data() + len, bytes.data() + bytes.size(), v, std::chars_format::fixed, decimals);
+    len = size_t(r.ptr - bytes.data());
+}
+
+size_t text::worker_count(size_t count, size_t grain) {
+    size_t hw = app::ThreadPool::shared().size();
+    size_t by_work = (count + grain - 1) / std::max<size_t>(1, grain);
+    return std::max<size_t>(1, std::min(hw, by_work));
+}
\ No newline at end of file
@@ -0,0 +1,69 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "thread_pool.h"
+
+namespace text {
+    // Append-only byte buffer with locale-free number formatting (std::to_chars).
+    // Floats are written like std::ostream's defaults (%g, 6 significant digits)
+    // so the output matches what operator<< produced.
+    class Buffer {
+    public:
+        void reserve(size_t n) { if(n > bytes.size()) bytes.resize(n); }
+        void clear() { len = 0; }
+
+        const char* data() const { return bytes.data(); }
+        size_t size() const { return len; }
+
+        void put(char c) { grow(1); bytes[len++] = c; }
+        void put(const char* s, size_t n) { grow(n); std::memcpy(bytes.data() + len, s, n); len += n; }
+        void put(const char* s) { put(s, std::strlen(s)); }
+        void put(const std::string& s) { put(s.data(), s.size()); }
+        void put(const Buffer& b) { put(b.data(), b.size()); }
+        void put(float v);
+        void put(int v);
+        void put(uint32_t v);
+        // Shortest text that reads back as exactly v.
+        void put_exact(float v);
+        // v with a fixed number of decimals and no exponent.
+        void put_fixed(float v, int decimals);
+
+    private:
+        void grow(size_t n) {
+            if(len + n > bytes.size())
+                bytes.resize(std::max(len + n, bytes.size() * 2 + 256));
+        }
+
+        std::vector<char> bytes;
+        size_t len = 0;
+    };
+
+    size_t worker_count(size_t count, size_t grain);
+
+    // Calls fmt(buffer, i) for every i in [0, count). Contiguous index ranges are
+    // formatted into per-thread buffers and appended to out in index order, so the
+    // bytes do not depend on the number of threads.
+    template <typename F>
+    void format_parallel(Buffer& out, size_t count, F&& fmt, size_t grain = 4096) {
+        size_t threads = worker_count(count, grain);
+        if(threads <= 1) {
+            for(size_t i = 0; i < count; ++i) fmt(out, i);
+            return;
+        }
+
+        std::vector<Buffer> parts(threads);
+        app::ThreadPool::shared().parallel_for(threads, [&](size_t t) {
+            size_t b = count * t / threads, e = count * (t + 1) / threads;
+            for(size_t i = b; i < e; ++i) fmt(parts[t], i);
+            });
+
+        size_t total = out.size();
+        for(const auto& p : parts) total += p.size();
+        out.reserve(total);
+        for(const auto& p : parts) out.put(p);
+    }
+}
\ No newline at end of file
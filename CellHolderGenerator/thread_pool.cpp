@@ -0,0 +1,52 @@
+#include "thread_pool.h"
+
+using app::ThreadPool;
+
+ThreadPool::ThreadPool(unsigned threads) {
+    if(threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    workers.reserve(threads - 1);
+    for(unsigned i = 1; i < threads; ++i)
+        workers.emplace_back([this] { work(); });
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m);
+        stopping = true;
+    }
+    cv.notify_all();
+    for(auto& w : workers) w.join();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(m);
+        tasks.push_back(std::move(task));
+    }
+    cv.notify_one();
+}
+
+void ThreadPool::work() {
+    for(;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m);
+            cv.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if(tasks.empty()) return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+static unsigned shared_threads = 0;
+
+void ThreadPool::set_shared_threads(unsigned threads) {
+    shared_threads = threads;
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool(shared_threads);
+    return pool;
+}
\ No newline at end of file
@@ -0,0 +1,95 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace app {
+    class ThreadPool {
+    public:
+        // threads == 0 uses std::thread::hardware_concurrency()
+        explicit ThreadPool(unsigned threads = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // Number of threads that execute work, counting the caller of parallel_for.
+        unsigned size() const { return unsigned(workers.size()) + 1; }
+
+        // Chunk size that splits n items into a few chunks per thread.
+        size_t grain(size_t n) const { return std::max<size_t>(1, n / (4 * size_t(size()))); }
+
+        void submit(std::function<void()> task);
+
+        // Calls body(i) for every i in [0, n), grain indices per task. The calling
+        // thread takes part and only waits for chunks other threads already
+        // started, so it is safe to call from inside a pool task.
+        template <typename F>
+        void parallel_for(size_t n, F&& body, size_t grain = 1);
+
+        // Process-wide pool used by the generation pipeline and the exporters.
+        // set_shared_threads only has an effect before the first shared() call.
+        static ThreadPool& shared();
+        static void set_shared_threads(unsigned threads);
+
+    private:
+        struct ForState {
+            std::atomic<size_t> next{ 0 };
+            size_t n = 0, grain = 1, done = 0;
+            std::function<void(size_t)> body;
+            std::mutex m;
+            std::condition_variable cv;
+
+            // takes chunks until none are left
+            void run() {
+                for(;;) {
+                    size_t b = next.fetch_add(grain);
+                    if(b >= n) return;
+                    size_t e = std::min(n, b + grain);
+                    for(size_t i = b; i < e; ++i) body(i);
+                    std::lock_guard<std::mutex> lock(m);
+                    done += e - b;
+                    if(done == n) cv.notify_all();
+                }
+            }
+        };
+
+        void work();
+
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()>> tasks;
+        std::mutex m;
+        std::condition_variable cv;
+        bool stopping = false;
+    };
+
+    template <typename F>
+    void ThreadPool::parallel_for(size_t n, F&& body, size_t grain) {
+        if(n == 0) return;
+        grain = std::max<size_t>(1, grain);
+        size_t chunks = (n + grain - 1) / grain;
+        if(chunks == 1 || workers.empty()) {
+            for(size_t i = 0; i < n; ++i) body(i);
+            return;
+        }
+
+        auto st = std::make_shared<ForState>();
+        st->n = n;
+        st->grain = grain;
+        st->body = [&body](size_t i) { body(i); };
+        size_t helpers = std::min<size_t>(workers.size(), chunks - 1);
+        for(size_t h = 0; h < helpers; ++h)
+            submit([st] { st->run(); });
+
+        st->run();
+        std::unique_lock<std::mutex> lock(st->m);
+        st->cv.wait(lock, [&] { return st->done == st->n; });
+    }
+}
\ No newline at end of file
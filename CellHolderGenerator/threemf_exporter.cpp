@@ -0,0 +1,184 @@
+#include "threemf_exporter.h"
+#include "output_sink.h"
+#include "profiler.h"
+#include "text_format.h"
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+namespace {
+    uint32_t crc32(const char* data, size_t n) {
+        static uint32_t table[256] = {};
+        static bool init = [] {
+            for(uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i;
+                for(int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                table[i] = c;
+            }
+            return true;
+            }();
+        (void)init;
+        uint32_t c = 0xFFFFFFFFu;
+        for(size_t i = 0; i < n; ++i) c = table[(c ^ uint8_t(data[i])) & 0xFF] ^ (c >> 8);
+        return c ^ 0xFFFFFFFFu;
+    }
+
+    // Store-only zip archive streamed into a sink; entries are written whole.
+    // Sizes, offsets and counts that do not fit the classic fields switch
+    // that entry, or the archive's end record, to ZIP64.
+    class ZipWriter {
+    public:
+        explicit ZipWriter(io::OutputSink& sink) : sink(sink) {}
+
+        void add(const char* name, const text::Buffer& data) {
+            Entry e{ name, crc32(data.data(), data.size()), data.size(), offset };
+            bool big = e.size >= zip32_max;
+            text::Buffer h;
+            u32(h, 0x04034b50); u16(h, big ? 45 : 20); u16(h, 0); u16(h, 0);
+            u16(h, 0); u16(h, 0x21); // 1980-01-01 00:00
+            u32(h, e.crc); u32(h, clamp32(e.size)); u32(h, clamp32(e.size));
+            u16(h, uint16_t(e.name.size())); u16(h, big ? 20 : 0);
+            h.put(e.name);
+            if(big) {
+                u16(h, 0x0001); u16(h, 16);
+                u64(h, e.size); u64(h, e.size);
+            }
+            emit(h);
+            emit(data);
+            entries.push_back(std::move(e));
+        }
+
+        bool finish() {
+            uint64_t cd = offset;
+            text::Buffer h;
+            for(const auto& e : entries) {
+                // the ZIP64 extra field holds, in order, only the values
+                // whose classic fields are saturated
+                bool bigSize = e.size >= zip32_max, bigOffset = e.offset >= zip32_max;
+                uint16_t extra = uint16_t((bigSize ? 16 : 0) + (bigOffset ? 8 : 0));
+                uint16_t version = extra ? 45 : 20;
+                u32(h, 0x02014b50); u16(h, version); u16(h, version); u16(h, 0); u16(h, 0);
+                u16(h, 0); u16(h, 0x21);
+                u32(h, e.crc); u32(h, clamp32(e.size)); u32(h, clamp32(e.size));
+                u16(h, uint16_t(e.name.size())); u16(h, extra ? extra + 4 : 0); u16(h, 0);
+                u16(h, 0); u16(h, 0); u32(h, 0); u32(h, clamp32(e.offset));
+                h.put(e.name);
+                if(extra) {
+                    u16(h, 0x0001); u16(h, extra);
+                    if(bigSize) { u64(h, e.size); u64(h, e.size); }
+                    if(bigOffset) u64(h, e.offset);
+                }
+            }
+            uint64_t cdSize = h.size();
+            uint64_t count = entries.size();
+            if(count >= 0xFFFF || cdSize >= zip32_max || cd >= zip32_max) {
+                uint64_t record = cd + cdSize;
+                u32(h, 0x06064b50); u64(h, 44); u16(h, 45); u16(h, 45);
+                u32(h, 0); u32(h, 0); u64(h, count); u64(h, count);
+                u64(h, cdSize); u64(h, cd);
+                u32(h, 0x07064b50); u32(h, 0); u64(h, record); u32(h, 1);
+            }
+            uint16_t count16 = uint16_t(std::min<uint64_t>(count, 0xFFFF));
+            u32(h, 0x06054b50); u16(h, 0); u16(h, 0);
+            u16(h, count16); u16(h, count16);
+            u32(h, clamp32(cdSize)); u32(h, clamp32(cd)); u16(h, 0);
+            emit(h);
+            return sink.close();
+        }
+
+    private:
+        struct Entry { std::string name; uint32_t crc; uint64_t size, offset; };
+
+        // 0xFFFFFFFF in a classic field means "see the ZIP64 field"
+        static constexpr uint64_t zip32_max = 0xFFFFFFFFu;
+        static uint32_t clamp32(uint64_t v) { return v >= zip32_max ? 0xFFFFFFFFu : uint32_t(v); }
+
+        static void u16(text::Buffer& b, uint16_t v) { char c[2] = { char(v), char(v >> 8) }; b.put(c, 2); }
+        static void u32(text::Buffer& b, uint32_t v) { u16(b, uint16_t(v)); u16(b, uint16_t(v >> 16)); }
+        static void u64(text::Buffer& b, uint64_t v) { u32(b, uint32_t(v)); u32(b, uint32_t(v >> 32)); }
+        void emit(const text::Buffer& b) { sink.write(b.data(), b.size()); offset += b.size(); }
+
+        io::OutputSink& sink;
+        std::vector<Entry> entries;
+        uint64_t offset = 0;
+    };
+
+    const char* content_types =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">"
+        "<Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\"/>"
+        "<Default Extension=\"model\" ContentType=\"application/vnd.ms-package.3dmanufacturing-3dmodel+xml\"/>"
+        "</Types>\n";
+
+    const char* rels =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">"
+        "<Relationship Target=\"/3D/3dmodel.model\" Id=\"rel0\" "
+        "Type=\"http://schemas.microsoft.com/3dmanufacturing/2013/01/3dmodel\"/>"
+        "</Relationships>\n";
+
+    void put_mesh_object(text::Buffer& out, int id, const Mesh& m) {
+        out.put("<object id=\""); out.put(id); out.put("\" type=\"model\"><mesh><vertices>\n");
+        text::format_parallel(out, m.vertices.size(), [&](text::Buffer& o, size_t i) {
+            const Vec3& v = m.vertices[i];
+            o.put("<vertex x=\""); o.put_exact(v.x);
+            o.put("\" y=\""); o.put_exact(v.y);
+            o.put("\" z=\""); o.put_exact(v.z); o.put("\"/>\n");
+            });
+        out.put("</vertices><triangles>\n");
+        text::format_parallel(out, m.faces.size(), [&](text::Buffer& o, size_t i) {
+            const Face& f = m.faces[i];
+            o.put("<triangle v1=\""); o.put(f.v1);
+            o.put("\" v2=\""); o.put(f.v2);
+            o.put("\" v3=\""); o.put(f.v3); o.put("\"/>\n");
+            });
+        out.put("</triangles></mesh></object>\n");
+    }
+
+    void put_model_header(text::Buffer& out) {
+        out.put("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            "<model unit=\"millimeter\" xml:lang=\"en-US\" "
+            "xmlns=\"http://schemas.microsoft.com/3dmanufacturing/core/2015/02\">\n<resources>\n");
+    }
+
+    bool write_package(const text::Buffer& model, const char* path) {
+        io::StreamSink sink(path);
+        if(!sink.ok()) return false;
+        ZipWriter zip(sink);
+        text::Buffer ct, rl;
+        ct.put(content_types);
+        rl.put(rels);
+        zip.add("[Content_Types].xml", ct);
+        zip.add("_rels/.rels", rl);
+        zip.add("3D/3dmodel.model", model);
+        return zip.finish();
+    }
+}
+
+bool ThreeMFExporter::export_mesh(const Mesh& mesh, const char* path) {
+    app::profile::Scope scope("3mf_write");
+    text::Buffer model;
+    put_model_header(model);
+    put_mesh_object(model, 1, mesh);
+    model.put("</resources>\n<build><item objectid=\"1\"/></build>\n</model>\n");
+    return write_package(model, path);
+}
+
+bool ThreeMFExporter::export_instanced(const Mesh& body, const Mesh& part,
+    const std::vector<Vec3>& offsets, const char* path) {
+    app::profile::Scope scope("3mf_write");
+    text::Buffer model;
+    put_model_header(model);
+    put_mesh_object(model, 1, body);
+    put_mesh_object(model, 2, part);
+
+    model.put("<object id=\"3\" type=\"model\"><components>\n<component objectid=\"1\"/>\n");
+    text::format_parallel(model, offsets.size(), [&](text::Buffer& o, size_t i) {
+        const Vec3& t = offsets[i];
+        o.put("<component objectid=\"2\" transform=\"1 0 0 0 1 0 0 0 1 ");
+        o.put_exact(t.x); o.put(' '); o.put_exact(t.y); o.put(' '); o.put_exact(t.z);
+        o.put("\"/>\n");
+        });
+    model.put("</components></object>\n</resources>\n<build><item objectid=\"3\"/></build>\n</model>\n");
+    return write_package(model, path);
+}
\ No newline at end of file
@@ -0,0 +1,21 @@
+#pragma once
+#include <vector>
+#include "mesh.h"
+#include "vec3.h"
+
+// 3MF package writer (store-only zip, ZIP64 once past 4 GB). Meshes are
+// written indexed, straight from Mesh::vertices / Mesh::faces.
+class ThreeMFExporter {
+public:
+    static bool export_mesh(const Mesh& mesh, const char* path);
+
+    // body is written once; part is written once and referenced as a
+    // component translated by each offset. Both are assembled into a single
+    // build item, so each should be a closed solid of its own.
+    static bool export_instanced(
+        const Mesh& body,
+        const Mesh& part,
+        const std::vector<Vec3>& offsets,
+        const char* path
+    );
+};
\ No newline at end of file
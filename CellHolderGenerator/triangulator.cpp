@@ -1,14 +1,391 @@
 ﻿#include "triangulator.h"
-#include <array>
-
-std::vector<uint32_t> geometry::triangulate(const std::vector<std::vector<Vec2>>& rings) {
-    std::vector<std::vector<std::array<double, 2>>> data;
-    data.reserve(rings.size());
-    for(auto& ring : rings) {
-        std::vector<std::array<double, 2>> r;
-        r.reserve(ring.size());
-        for(auto& v : ring) r.push_back({ v.x, v.y });
-        data.push_back(std::move(r));
-    }
-    return mapbox::earcut<uint32_t>(data);
-}
\ No newline at end of file
+#include "thread_pool.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+using geometry::Triangulator;
+using geometry::Lattice;
+
+const std::vector<uint32_t>& Triangulator::triangulate(const RingSet& rings) {
+    earcut(rings);
+    return earcut.indices;
+}
+
+const std::vector<uint32_t>& Triangulator::triangulate(std::span<const std::span<const Vec2>> rings) {
+    earcut(rings);
+    return earcut.indices;
+}
+
+std::vector<uint32_t> geometry::triangulate(const RingSet& rings) {
+    Triangulator t;
+    return t.triangulate(rings);
+}
+
+geometry::CapTriangulation geometry::triangulate_lattice(const RingSet& rings, const Lattice& lattice) {
+    Triangulator t;
+    return t.triangulate_lattice(rings, lattice);
+}
+
+namespace {
+    // Tile corners live on an integer grid: x in half pitches, y in half rows
+    // (square) or thirds of a row (honeycomb).
+    struct Key { int x, y; };
+
+    inline uint64_t pack(Key k) { return (uint64_t(uint32_t(k.x)) << 32) | uint32_t(k.y); }
+
+    // Corners of the tile around cell (row, col), counter-clockwise.
+    int tile_corners(const Lattice& L, int row, int col, Key* out) {
+        int kx = 2 * col + ((L.honeycomb && (row % 2)) ? 1 : 0);
+        if(!L.honeycomb) {
+            out[0] = { kx - 1, 2 * row - 1 };
+            out[1] = { kx + 1, 2 * row - 1 };
+            out[2] = { kx + 1, 2 * row + 1 };
+            out[3] = { kx - 1, 2 * row + 1 };
+            return 4;
+        }
+        int ky = 3 * row;
+        out[0] = { kx,     ky - 2 };
+        out[1] = { kx + 1, ky - 1 };
+        out[2] = { kx + 1, ky + 1 };
+        out[3] = { kx,     ky + 2 };
+        out[4] = { kx - 1, ky + 1 };
+        out[5] = { kx - 1, ky - 1 };
+        return 6;
+    }
+
+    Vec2 corner_pos(const Lattice& L, Key k) {
+        double x = double(L.x0) + double(k.x) * 0.5 * double(L.pitch);
+        double y = L.honeycomb
+            ? double(L.y0) + double(k.y) * double(L.vstep) / 3.0
+            : double(L.y0) + double(k.y) * 0.5 * double(L.vstep);
+        if(L.angle == 0.f) return { float(x), float(y) };
+        double c = std::cos(double(L.angle)), s = std::sin(double(L.angle));
+        return { float(c * x - s * y), float(s * x + c * y) };
+    }
+
+    bool inside(std::span<const Vec2> poly, Vec2 p) {
+        bool in = false;
+        for(size_t i = 0, j = poly.size() - 1; i < poly.size(); j = i++) {
+            const Vec2& a = poly[i];
+            const Vec2& b = poly[j];
+            if((a.y > p.y) != (b.y > p.y)) {
+                double x = double(a.x) + (double(p.y) - a.y) * (double(b.x) - a.x) / (double(b.y) - a.y);
+                if(double(p.x) < x) in = !in;
+            }
+        }
+        return in;
+    }
+
+    double area2(Vec2 p, Vec2 q, Vec2 r) {
+        return (double(q.y) - p.y) * (double(r.x) - q.x) - (double(q.x) - p.x) * (double(r.y) - q.y);
+    }
+}
+
+const geometry::CapTriangulation& Triangulator::triangulate_lattice(const RingSet& rings, const Lattice& L) {
+    size_t cells = size_t(std::max(0, L.cols)) * size_t(std::max(0, L.rows));
+    identity.clear();
+    if(rings.size() == 1 + cells)
+        for(size_t i = 0; i < cells; ++i) identity.push_back(int32_t(1 + i));
+    return triangulate_lattice(rings, L, identity);
+}
+
+const geometry::CapTriangulation& Triangulator::triangulate_lattice(const RingSet& rings, const Lattice& L,
+    std::span<const int32_t> cell_ring) {
+    if(!tile_lattice(rings, L, cell_ring)) {
+        const auto& I = triangulate(rings);
+        cap.extra.clear();
+        cap.indices.assign(I.begin(), I.end());
+    }
+    return cap;
+}
+
+bool Triangulator::tile_lattice(const RingSet& rings, const Lattice& L, std::span<const int32_t> cell_ring) {
+    size_t cells = size_t(std::max(0, L.cols)) * size_t(std::max(0, L.rows));
+    if(cells == 0 || cell_ring.size() != cells || L.hole_radius >= 0.5f * L.pitch)
+        return false;
+
+    // rings of no cell bound the plate: the outer ring and any keep-outs
+    tiled.assign(rings.size(), 0);
+    for(int32_t r : cell_ring) {
+        if(r < 0) continue;
+        if(r == 0 || size_t(r) >= rings.size() || tiled[r]) return false;
+        tiled[r] = 1;
+    }
+    poly.clear();
+    for(size_t i = 0; i < rings.size(); ++i)
+        if(!tiled[i]) poly.push_back(rings[i]);
+    boundary.build(poly, L.pitch);
+
+    const std::vector<uint32_t>& start = rings.offsets;
+    uint32_t total = uint32_t(rings.pts.size());
+    cap.extra.clear();
+    cap.indices.clear();
+
+    // corner keys -> extra vertex ids; occupied tiles inside the plate and
+    // crossed by none of its boundaries are interior
+    corner_id.clear();
+    corner_key.clear();
+    auto corner = [&](Key k) -> uint32_t {
+        auto [it, added] = corner_id.try_emplace(pack(k), uint32_t(total + cap.extra.size()));
+        if(added) {
+            cap.extra.push_back(corner_pos(L, k));
+            corner_key.push_back(pack(k));
+        }
+        return it->second;
+        };
+
+    auto clear_of_boundary = [&](const Vec2* p, int nc) {
+        Vec2 lo = p[0], hi = p[0];
+        for(int i = 0; i < nc; ++i) {
+            if(!boundary.inside(p[i])) return false;
+            lo = { std::min(lo.x, p[i].x), std::min(lo.y, p[i].y) };
+            hi = { std::max(hi.x, p[i].x), std::max(hi.y, p[i].y) };
+        }
+        return !boundary.any(lo, hi, [&](const EdgeGrid::Edge& e) {
+            bool a_in = true, b_in = true;
+            for(int i = 0; i < nc; ++i) {
+                Vec2 p0 = p[i], p1 = p[(i + 1) % nc];
+                a_in &= area2(p0, p1, e.a) < 0.0;
+                b_in &= area2(p0, p1, e.b) < 0.0;
+                double o1 = area2(e.a, e.b, p0), o2 = area2(e.a, e.b, p1);
+                double o3 = area2(p0, p1, e.a), o4 = area2(p0, p1, e.b);
+                if(((o1 > 0.0 && o2 < 0.0) || (o1 < 0.0 && o2 > 0.0))
+                    && ((o3 > 0.0 && o4 < 0.0) || (o3 < 0.0 && o4 > 0.0))) return true;
+            }
+            return a_in || b_in;
+            });
+        };
+
+    auto& pool = app::ThreadPool::shared();
+    size_t rows = size_t(L.rows), cols = size_t(L.cols);
+    int nc = L.honeycomb ? 6 : 4;
+    interior.assign(cells, 0);
+    pool.parallel_for(rows, [&](size_t r) {
+        for(size_t c = 0; c < cols; ++c) {
+            if(cell_ring[r * cols + c] < 0) continue;
+            Key k[6];
+            Vec2 p[6];
+            tile_corners(L, int(r), int(c), k);
+            for(int i = 0; i < nc; ++i) p[i] = corner_pos(L, k[i]);
+            interior[r * cols + c] = clear_of_boundary(p, nc);
+        }
+        }, pool.grain(rows));
+
+    // square tiles meeting only at a corner would pinch the border band;
+    // drop one of them until no such corner is left (hexagons cannot pinch)
+    for(bool changed = !L.honeycomb; changed;) {
+        changed = false;
+        for(size_t r = 1; r < rows; ++r) {
+            for(size_t c = 1; c < cols; ++c) {
+                char* lo = &interior[(r - 1) * cols + c - 1];
+                char* hi = &interior[r * cols + c - 1];
+                if(lo[0] && hi[1] && !lo[1] && !hi[0]) { hi[1] = 0; changed = true; }
+                else if(lo[1] && hi[0] && !lo[0] && !hi[1]) { hi[0] = 0; changed = true; }
+            }
+        }
+    }
+
+    // corner ids are assigned serially in row-major order so the extra
+    // vertex numbering does not depend on the thread count
+    tile_ids.resize(cells * 6);
+    row_first.assign(rows + 1, 0);
+    size_t first_interior = cells;
+    for(size_t r = 0; r < rows; ++r) {
+        row_first[r + 1] = row_first[r];
+        for(size_t c = 0; c < cols; ++c) {
+            size_t cell = r * cols + c;
+            if(!interior[cell]) continue;
+            Key k[6];
+            tile_corners(L, int(r), int(c), k);
+            for(int i = 0; i < nc; ++i) tile_ids[cell * 6 + i] = corner(k[i]);
+            if(first_interior == cells) first_interior = cell;
+            ++row_first[r + 1];
+        }
+    }
+    if(first_interior == cells) return false;
+
+    auto pos = [&](uint32_t id) { return id < total ? Vec2{} : cap.extra[id - total]; };
+
+    // boundary of the union of interior tiles: tile edges not shared with another interior tile
+    edges.clear();
+    for(size_t cell = 0; cell < cells; ++cell) {
+        if(!interior[cell]) continue;
+        for(int i = 0; i < nc; ++i) {
+            uint32_t a = tile_ids[cell * 6 + i], b = tile_ids[cell * 6 + (i + 1) % nc];
+            auto rev = edges.find((uint64_t(b) << 32) | a);
+            if(rev != edges.end()) edges.erase(rev);
+            else edges[(uint64_t(a) << 32) | b] = b;
+        }
+    }
+    succ.clear();
+    bool simple = true;
+    for(const auto& [e, b] : edges) simple &= succ.emplace(uint32_t(e >> 32), b).second;
+    if(!simple) return false;
+
+    // split the union boundary into closed loops
+    loop.clear();
+    loop_first.assign(1, 0);
+    loop_at.clear();
+    for(const auto& [s, next] : succ) {
+        if(loop_at.count(s)) continue;
+        uint32_t v = s;
+        do {
+            if(!loop_at.emplace(v, uint32_t(loop.size())).second) return false;
+            loop.push_back(v);
+            auto it = succ.find(v);
+            if(it == succ.end()) return false;
+            v = it->second;
+        } while(v != s);
+        loop_first.push_back(loop.size());
+    }
+    size_t loops = loop_first.size() - 1;
+    loop_pts.clear();
+    for(uint32_t v : loop) loop_pts.push_back(pos(v));
+    auto loop_span = [&](size_t k) {
+        return std::span<const Vec2>(loop_pts).subspan(loop_first[k], loop_first[k + 1] - loop_first[k]);
+        };
+
+    // one tile triangulated once: corners as the outer ring, the cell's hole inside
+    tile_pts.clear();
+    for(int i = 0; i < nc; ++i) tile_pts.push_back(pos(tile_ids[first_interior * 6 + i]));
+    poly.assign({ std::span<const Vec2>(tile_pts), rings[cell_ring[first_interior]] });
+    const auto& T = triangulate(poly);
+    stamp.assign(T.begin(), T.end());
+
+    // stamp row bands in parallel into their precomputed slots
+    cap.indices.resize(row_first[rows] * stamp.size());
+    pool.parallel_for(rows, [&](size_t r) {
+        uint32_t* dst = cap.indices.data() + row_first[r] * stamp.size();
+        for(size_t cell = r * cols; cell < (r + 1) * cols; ++cell) {
+            if(!interior[cell]) continue;
+            for(uint32_t i : stamp)
+                *dst++ = i < uint32_t(nc) ? tile_ids[cell * 6 + i] : start[cell_ring[cell]] + (i - nc);
+        }
+        }, pool.grain(rows));
+
+    // border band: the plate, minus the interior union, minus the remaining
+    // rings. Counter-clockwise loops bound pieces of the union; clockwise
+    // loops are holes in it, each the outer ring of a band piece of its own.
+    // Everything else goes to the innermost piece containing it.
+    for(size_t cell = 0; cell < cells; ++cell)
+        if(interior[cell]) tiled[cell_ring[cell]] = 2;
+    clockwise.clear();
+    for(size_t k = 0; k < loops; ++k) {
+        auto pts = loop_span(k);
+        double a = 0.0;
+        for(size_t i = 0, n = pts.size(); i < n; ++i)
+            a += double(pts[i].x) * pts[(i + 1) % n].y - double(pts[i].y) * pts[(i + 1) % n].x;
+        if(a < 0.0) clockwise.push_back(k);
+    }
+    auto piece_of = [&](Vec2 p) {
+        size_t best = 0;
+        double best_area = INFINITY;
+        for(size_t j = 0; j < clockwise.size(); ++j) {
+            auto pts = loop_span(clockwise[j]);
+            if(!inside(pts, p)) continue;
+            double a = 0.0;
+            for(size_t i = 0, n = pts.size(); i < n; ++i)
+                a -= double(pts[i].x) * pts[(i + 1) % n].y - double(pts[i].y) * pts[(i + 1) % n].x;
+            if(a < best_area) { best = 1 + j; best_area = a; }
+        }
+        return best;
+        };
+    piece.assign(loops + rings.size(), 0);
+    if(!clockwise.empty()) {
+        for(size_t k = 0; k < loops; ++k) piece[k] = piece_of(loop_span(k)[0]);
+        for(size_t i = 1; i < rings.size(); ++i)
+            if(tiled[i] != 2 && rings.count(i)) piece[loops + i] = piece_of(rings[i][0]);
+    }
+
+    poly.assign({ rings[0] });
+    ids.clear();
+    for(uint32_t i = 0; i < rings.count(0); ++i) ids.push_back(start[0] + i);
+    triangulate_band(rings, 0);
+    for(size_t j = 0; j < clockwise.size(); ++j) {
+        poly.assign({ loop_span(clockwise[j]) });
+        ids.assign(loop.begin() + loop_first[clockwise[j]], loop.begin() + loop_first[clockwise[j] + 1]);
+        triangulate_band(rings, 1 + j);
+    }
+    return true;
+}
+
+// Triangulates band piece p, whose outer ring is already in poly and ids.
+void Triangulator::triangulate_band(const RingSet& rings, size_t p) {
+    size_t loops = loop_first.size() - 1;
+    uint32_t total = uint32_t(rings.pts.size());
+    auto pos = [&](uint32_t id) { return id < total ? rings.pts[id] : cap.extra[id - total]; };
+
+    for(size_t k = 0; k < loops; ++k) {
+        if(piece[k] != p) continue;
+        if(!clockwise.empty() && std::find(clockwise.begin(), clockwise.end(), k) != clockwise.end()) continue;
+        poly.push_back(std::span<const Vec2>(loop_pts).subspan(loop_first[k], loop_first[k + 1] - loop_first[k]));
+        ids.insert(ids.end(), loop.begin() + loop_first[k], loop.begin() + loop_first[k + 1]);
+    }
+    for(size_t i = 1; i < rings.size(); ++i) {
+        if(tiled[i] == 2 || piece[loops + i] != p) continue;
+        poly.push_back(rings[i]);
+        for(uint32_t j = 0; j < rings.count(i); ++j) ids.push_back(rings.start(i) + j);
+    }
+
+    const std::vector<uint32_t>& I = triangulate(poly);
+
+    // earcut drops collinear points, which would leave T-junctions against
+    // the stamped tiles; split such triangles back at every loop vertex on
+    // their sides. Corners sit on an integer grid, so the corners on a side
+    // are the grid points between its ends (on any loop, not just its own)
+    auto on_side = [&](uint32_t a, uint32_t b, std::vector<uint32_t>& out) {
+        out.clear();
+        if(a < total || b < total || a - total >= corner_key.size() || b - total >= corner_key.size()) return;
+        uint64_t ka = corner_key[a - total], kb = corner_key[b - total];
+        int x = int32_t(ka >> 32), y = int32_t(ka);
+        int dx = int32_t(kb >> 32) - x, dy = int32_t(kb) - y;
+        int g = std::gcd(dx, dy);
+        for(int s = 1; s < g; ++s) {
+            auto it = corner_id.find(pack({ x + dx / g * s, y + dy / g * s }));
+            if(it != corner_id.end() && loop_at.count(it->second)) out.push_back(it->second);
+        }
+        };
+
+    // a triangle with dropped vertices on one side is fanned from the
+    // opposite corner; with more than one side it is fanned from a new
+    // vertex at its centroid, since any corner would give flat triangles
+    for(size_t t = 0; t + 2 < I.size(); t += 3) {
+        uint32_t v[3] = { ids[I[t]], ids[I[t + 1]], ids[I[t + 2]] };
+        int split = 0, last = 0;
+        bool flat = false;
+        for(int e = 0; e < 3; ++e) {
+            on_side(v[e], v[(e + 1) % 3], side[e]);
+            if(side[e].empty()) continue;
+            flat |= std::find(side[e].begin(), side[e].end(), v[(e + 2) % 3]) != side[e].end();
+            ++split;
+            last = e;
+        }
+        // a sliver whose corner lies on its opposite side has no area; the
+        // neighbour across that side is split at the corner instead
+        if(flat) continue;
+        if(split == 0) {
+            cap.indices.insert(cap.indices.end(), { v[0], v[1], v[2] });
+        }
+        else if(split == 1) {
+            uint32_t prev = v[last], b = v[(last + 1) % 3], w = v[(last + 2) % 3];
+            for(uint32_t m : side[last]) {
+                cap.indices.insert(cap.indices.end(), { prev, m, w });
+                prev = m;
+            }
+            cap.indices.insert(cap.indices.end(), { prev, b, w });
+        }
+        else {
+            rim.clear();
+            for(int e = 0; e < 3; ++e) {
+                rim.push_back(v[e]);
+                rim.insert(rim.end(), side[e].begin(), side[e].end());
+            }
+            Vec2 p0 = pos(v[0]), p1 = pos(v[1]), p2 = pos(v[2]);
+            uint32_t c = uint32_t(total + cap.extra.size());
+            cap.extra.push_back({ (p0.x + p1.x + p2.x) / 3.f, (p0.y + p1.y + p2.y) / 3.f });
+            for(size_t k = 0; k < rim.size(); ++k)
+                cap.indices.insert(cap.indices.end(), { rim[k], rim[(k + 1) % rim.size()], c });
+        }
+    }
+}
@@ -1,8 +1,85 @@
 #pragma once
+#include <cstdint>
+#include <span>
+#include <unordered_map>
 #include <vector>
 #include "vec2.h"
+#include "edge_grid.h"
+#include "lattice.h"
+#include "ring_set.h"
 #include "earcut.h"
 
+namespace mapbox::util {
+    template <> struct nth<0, Vec2> { static float get(const Vec2& v) { return v.x; } };
+    template <> struct nth<1, Vec2> { static float get(const Vec2& v) { return v.y; } };
+}
+
 namespace geometry {
-    std::vector<uint32_t> triangulate(const std::vector<std::vector<Vec2>>& rings);
+    // Cap triangulation that may use vertices beyond the rings. Indices below
+    // rings.pts.size() address rings.pts; higher indices address
+    // extra[i - rings.pts.size()].
+    struct CapTriangulation {
+        std::vector<Vec2> extra;
+        std::vector<uint32_t> indices;
+    };
+
+    // Reusable earcut front end. Rings are read in place as Vec2 (no copy into
+    // double arrays), and the earcut node pool, index buffer and lattice
+    // scratch tables are kept across calls, so triangulating plate after plate
+    // allocates only when a plate is larger than any seen before.
+    // Returned references stay valid until the next call.
+    class Triangulator {
+    public:
+        const std::vector<uint32_t>& triangulate(const RingSet& rings);
+        const std::vector<uint32_t>& triangulate(std::span<const std::span<const Vec2>> rings);
+
+        // Triangulates an outer ring plus one hole per lattice cell (rings[1 + row * cols + col]).
+        // The web around each hole is periodic, so one lattice tile is triangulated
+        // once and stamped onto every tile that lies inside the outer ring; only the
+        // border band between those tiles and the outer ring goes through earcut.
+        // Falls back to triangulate() when the lattice does not allow tiling.
+        const CapTriangulation& triangulate_lattice(const RingSet& rings, const Lattice& lattice);
+
+        // Same for a partly filled lattice, as packed into an arbitrary outline:
+        // cell_ring[row * cols + col] is the ring of that cell's hole, or -1 for
+        // an empty cell. Rings no cell names (ring 0 and e.g. keep-outs) bound
+        // the plate. A tile is stamped only when it clears all of them, and the
+        // border band may split into several pieces.
+        const CapTriangulation& triangulate_lattice(const RingSet& rings, const Lattice& lattice,
+            std::span<const int32_t> cell_ring);
+
+    private:
+        bool tile_lattice(const RingSet& rings, const Lattice& lattice, std::span<const int32_t> cell_ring);
+        void triangulate_band(const RingSet& rings, size_t piece);
+
+        mapbox::detail::Earcut<uint32_t> earcut;
+        CapTriangulation cap;
+
+        std::unordered_map<uint64_t, uint32_t> corner_id;
+        std::vector<uint64_t> corner_key;
+        std::unordered_map<uint64_t, uint32_t> edges;
+        std::unordered_map<uint32_t, uint32_t> succ;
+        std::unordered_map<uint32_t, uint32_t> loop_at;
+        std::vector<char> interior;
+        std::vector<char> tiled;
+        std::vector<int32_t> identity;
+        std::vector<size_t> loop_first;
+        std::vector<size_t> clockwise;
+        std::vector<size_t> piece;
+        EdgeGrid boundary;
+        std::vector<uint32_t> tile_ids;
+        std::vector<size_t> row_first;
+        std::vector<uint32_t> loop;
+        std::vector<uint32_t> ids;
+        std::vector<uint32_t> stamp;
+        std::vector<uint32_t> side[3];
+        std::vector<uint32_t> rim;
+        std::vector<Vec2> tile_pts;
+        std::vector<Vec2> loop_pts;
+        std::vector<std::span<const Vec2>> poly;
+    };
+
+    // One-shot wrappers around a temporary Triangulator.
+    std::vector<uint32_t> triangulate(const RingSet& rings);
+    CapTriangulation triangulate_lattice(const RingSet& rings, const Lattice& lattice);
 }
\ No newline at end of file
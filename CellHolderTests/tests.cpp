@@ -0,0 +1,477 @@
+// Regression tests for the holder pipeline and its parts. Every check that
+// fails prints its file, line and expression; the exit code is the number of
+// failed checks.
+//
+//   CellHolderTests [--keep]       (--keep leaves the scratch directory)
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "cache.h"
+#include "dxf_exporter.h"
+#include "dxf_reader.h"
+#include "parameters.h"
+#include "pipeline.h"
+#include "profiler.h"
+#include "server.h"
+#include "stl_exporter.h"
+#include "sweep.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+    int failures = 0;
+
+#define CHECK(expr) \
+    do { if(!(expr)) { ++failures; std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #expr); } } while(0)
+
+    fs::path scratch;
+
+    std::string read_file(const fs::path& path) {
+        std::ifstream in(path, std::ios::binary);
+        return { std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>() };
+    }
+
+    void write_file(const fs::path& path, const std::string& bytes) {
+        std::ofstream(path, std::ios::binary) << bytes;
+    }
+
+    bool ran(const app::Pipeline& p, const char* name) {
+        for(const char* n : p.recomputed())
+            if(std::strcmp(n, name) == 0) return true;
+        return false;
+    }
+
+    // A small pack with every output in dir.
+    app::Parameters small_pack(const fs::path& dir) {
+        app::Parameters p;
+        p.series = 4;
+        p.parallel = 2;
+        p.chord_tol_mm = 0.05f;
+        p.set_output_stem((dir / "pack").string());
+        return p;
+    }
+
+    // Closed, consistently oriented triangle soup: every directed edge is
+    // matched by exactly as many edges running the other way. Vertices are
+    // compared by their exact coordinates; zero-length edges are skipped.
+    using Point = std::array<float, 3>;
+    bool closed(const std::vector<std::array<Point, 3>>& tris) {
+        std::map<std::pair<Point, Point>, int> edges;
+        for(const auto& t : tris)
+            for(int k = 0; k < 3; ++k) {
+                const Point& a = t[k];
+                const Point& b = t[(k + 1) % 3];
+                if(a < b) ++edges[{ a, b }];
+                else if(b < a) --edges[{ b, a }];
+            }
+        for(const auto& [e, n] : edges)
+            if(n != 0) return false;
+        return !tris.empty();
+    }
+
+    std::vector<std::array<Point, 3>> read_binary_stl(const fs::path& path) {
+        std::string b = read_file(path);
+        std::vector<std::array<Point, 3>> tris;
+        if(b.size() < 84) return tris;
+        uint32_t n;
+        std::memcpy(&n, b.data() + 80, 4);
+        if(b.size() != 84 + size_t(n) * 50) return tris;
+        tris.resize(n);
+        for(uint32_t i = 0; i < n; ++i)
+            std::memcpy(tris[i].data(), b.data() + 84 + size_t(i) * 50 + 12, 36);
+        return tris;
+    }
+
+    // The meshes of every object in a 3MF package. The package is stored
+    // uncompressed, so the model is read straight out of the zip.
+    std::vector<std::vector<std::array<Point, 3>>> read_3mf_meshes(const fs::path& path) {
+        std::string b = read_file(path);
+        std::vector<std::vector<std::array<Point, 3>>> meshes;
+        for(size_t at = b.find("<mesh>"); at != std::string::npos; at = b.find("<mesh>", at)) {
+            size_t end = b.find("</mesh>", at);
+            if(end == std::string::npos) break;
+            std::vector<Point> verts;
+            auto& tris = meshes.emplace_back();
+            for(size_t v = b.find("<vertex ", at); v < end; v = b.find("<vertex ", v + 1)) {
+                Point pt;
+                if(std::sscanf(b.c_str() + v, "<vertex x=\"%f\" y=\"%f\" z=\"%f\"", &pt[0], &pt[1], &pt[2]) == 3)
+                    verts.push_back(pt);
+            }
+            for(size_t t = b.find("<triangle ", at); t < end; t = b.find("<triangle ", t + 1)) {
+                size_t i[3];
+                if(std::sscanf(b.c_str() + t, "<triangle v1=\"%zu\" v2=\"%zu\" v3=\"%zu\"", &i[0], &i[1], &i[2]) != 3
+                    || std::max({ i[0], i[1], i[2] }) >= verts.size()) {
+                    tris.clear();
+                    break;
+                }
+                tris.push_back({ verts[i[0]], verts[i[1]], verts[i[2]] });
+            }
+            at = end;
+        }
+        return meshes;
+    }
+
+    // Even-odd test against a closed polyline.
+    bool inside(const std::vector<Vec2>& ring, Vec2 p) {
+        bool in = false;
+        for(size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++) {
+            const Vec2& a = ring[i];
+            const Vec2& b = ring[j];
+            if((a.y > p.y) != (b.y > p.y) && p.x < a.x + (b.x - a.x) * (p.y - a.y) / (b.y - a.y)) in = !in;
+        }
+        return in;
+    }
+
+    void test_cache_entries() {
+        app::Cache cache(scratch / "entries");
+        std::vector<int> values{ 1, 2, 3 };
+        app::CacheKey key("test");
+        key.add(1);
+        CHECK(cache.store(key, { app::as_bytes(values) }));
+
+        auto hit = cache.find(key);
+        CHECK(hit && hit.arrays() == 1);
+        if(hit && hit.arrays() == 1) {
+            auto a = hit.array<int>(0);
+            CHECK(std::vector<int>(a.begin(), a.end()) == values);
+        }
+
+        app::CacheKey other("test");
+        other.add(2);
+        CHECK(!cache.find(other));
+    }
+
+    void test_cache_outputs() {
+        const app::Cache cache(scratch / "outputs");
+        fs::create_directories(scratch / "a");
+        fs::create_directories(scratch / "b");
+        app::Parameters pa = small_pack(scratch / "a"), pb = small_pack(scratch / "b");
+
+        app::Pipeline first(&cache);
+        CHECK(first.update(pa));
+        CHECK(ran(first, "cap"));
+
+        // a fresh pipeline is served every output from the cache
+        app::Pipeline second(&cache);
+        CHECK(second.update(pb));
+        CHECK(!ran(second, "cap"));
+        CHECK(read_file(pb.stl_path) == read_file(pa.stl_path));
+        CHECK(read_file(pb.threemf_path) == read_file(pa.threemf_path));
+        CHECK(read_file(pb.dxf_path) == read_file(pa.dxf_path));
+
+        // an output edited in place does not reach the cache
+        write_file(pb.stl_path, "edited");
+        app::Pipeline third(&cache);
+        CHECK(third.update(pb));
+        CHECK(read_file(pb.stl_path) == read_file(pa.stl_path));
+
+        // cached copies that no longer match their checksum are misses
+        for(const auto& e : fs::directory_iterator(scratch / "outputs"))
+            if(e.path().extension() == ".out") {
+                std::string bytes = read_file(e.path());
+                bytes[bytes.size() / 2] ^= 1;
+                write_file(e.path(), bytes);
+            }
+        app::Pipeline fourth(&cache);
+        CHECK(fourth.update(pb));
+        CHECK(ran(fourth, "cap"));
+        CHECK(read_file(pb.stl_path) == read_file(pa.stl_path));
+
+        // a changed setting misses again
+        pb.wall_height += 2.f;
+        CHECK(fourth.update(pb));
+        CHECK(ran(fourth, "stl") && !ran(fourth, "dxf"));
+        CHECK(read_file(pb.stl_path) != read_file(pa.stl_path));
+    }
+
+    void test_watertight() {
+        fs::create_directories(scratch / "mesh");
+        for(bool honeycomb : { true, false }) {
+            app::Parameters p = small_pack(scratch / "mesh");
+            p.honeycomb = honeycomb;
+            p.export_3mf = false;
+            app::Pipeline pipeline;
+            CHECK(pipeline.update(p));
+            CHECK(closed(read_binary_stl(p.stl_path)));
+        }
+
+        // the 3MF's plate and cell collar are each closed on their own, for
+        // both lattices and for a packed outline
+        for(int shape = 0; shape < 3; ++shape) {
+            app::Parameters p = small_pack(scratch / "mesh");
+            p.honeycomb = shape != 1;
+            if(shape == 2) CHECK(p.set("outline", "0,0 120,0 140,60 60,90 0,60"));
+            app::Pipeline pipeline;
+            CHECK(pipeline.update(p));
+            auto meshes = read_3mf_meshes(p.threemf_path);
+            CHECK(meshes.size() == 2);
+            for(const auto& m : meshes) CHECK(closed(m));
+        }
+    }
+
+    void test_stl_count() {
+        fs::path path = scratch / "count.stl";
+        geometry::Triangle t{ { 0, 0, 0 }, { 1, 0, 0 }, { 0, 1, 0 } };
+        geometry::Triangle tris[3] = { t, t, t };
+
+        STLExporter::BinaryWriter exact(path.string().c_str(), 3);
+        exact.consume(tris, 3);
+        CHECK(exact.close());
+        CHECK(read_binary_stl(path).size() == 3);
+
+        // more or fewer facets than announced fail and keep the old file
+        STLExporter::BinaryWriter more(path.string().c_str(), 2);
+        more.consume(tris, 3);
+        CHECK(!more.close());
+        STLExporter::BinaryWriter fewer(path.string().c_str(), 3);
+        fewer.consume(tris, 2);
+        CHECK(!fewer.close());
+        CHECK(read_binary_stl(path).size() == 3);
+    }
+
+    // Without an outline the optimizer packs the plate the fixed rectangle
+    // gets, rounded corners included, and keeps its cells.
+    void test_optimize_box() {
+        fs::create_directories(scratch / "optimize");
+        app::Parameters p = small_pack(scratch / "optimize");
+        app::CellLayout::FitResult fixed = app::CellLayout::fitRect(p.width, p.height, p.cell_dia,
+            p.spacing, p.wall_thickness, p.series, p.parallel, p.honeycomb);
+        p.optimize_s = 0.05f;
+        app::Pipeline pipeline;
+        CHECK(pipeline.update(p));
+        CHECK(pipeline.packed_outline() && pipeline.packed_cells() == 8);
+        const auto& outline = pipeline.layout().boundary[0];
+        Vec2 hi{ 0.f, 0.f };
+        for(const Vec2& v : outline) hi = { std::max(hi.x, v.x), std::max(hi.y, v.y) };
+        CHECK(std::fabs(hi.x - fixed.reqWidth) < 0.01f && std::fabs(hi.y - fixed.reqHeight) < 0.01f);
+        CHECK(!inside({ outline.begin(), outline.end() }, { 0.1f, 0.1f }));
+    }
+
+    void test_sweep() {
+        app::SweepSpec spec;
+        spec.width = 120.f;
+        spec.height = 80.f;
+        spec.spacing_max = 1.5f;
+        spec.target_series = 4;
+        spec.min_parallel = 2;
+        auto most = app::sweep(spec);
+        CHECK(!most.empty());
+        for(const auto& c : most) CHECK(c.spacing >= 0.5f && c.spacing <= 1.5f + 1e-4f);
+
+        // every row count that fits, so the exact 4s2p is among them
+        spec.all_rows = true;
+        auto all = app::sweep(spec);
+        CHECK(all.size() > most.size());
+        CHECK(std::any_of(all.begin(), all.end(), [](const app::Candidate& c) {
+            return c.series == 4 && c.parallel == 2;
+        }));
+        CHECK(std::none_of(most.begin(), most.end(), [](const app::Candidate& c) {
+            return c.series == 4 && c.parallel == 2;
+        }));
+    }
+
+    void test_settings() {
+        app::Parameters p;
+        CHECK(!p.set("series", "0"));
+        CHECK(!p.set("parallel", "-3"));
+        CHECK(!p.set("cell_dia", "0"));
+        CHECK(!p.set("wall_height", "-1"));
+        CHECK(!p.set("width", "inf"));
+        CHECK(p.set("series", "3") && p.series == 3);
+        CHECK(!p.set("retract_speed", "0"));
+        CHECK(p.set("retract_speed", "25") && p.retract_speed == 25.f);
+
+        auto fit = app::CellLayout::fitRect(100.f, 100.f, 21.f, 0.5f, 1.f, 0, 2, true);
+        CHECK(!fit.fits && fit.maxSeries == 0 && fit.maxParallel == 0);
+        fit = app::CellLayout::fitRect(1e30f, 1e30f, 1e-20f, 1e-20f, 0.f, 5, 5, false);
+        CHECK(fit.fits && fit.maxSeries == 5);
+
+        write_file(scratch / "dup.ini", "series = 4\n[one]\n[two]\n[one]\n");
+        std::vector<app::Parameters> jobs;
+        std::string error;
+        CHECK(!app::read_manifest((scratch / "dup.ini").string().c_str(), jobs, error));
+        CHECK(error.find("duplicate job 'one'") != std::string::npos);
+    }
+
+    void test_server() {
+        app::Server server(nullptr, (scratch / "server").string());
+        std::mutex m;
+        std::map<std::string, std::string> replies; // by id
+        auto send = [&](const std::string& id, const std::string& line) {
+            server.handle(line, [&, id](const std::string& r) {
+                std::lock_guard<std::mutex> lock(m);
+                replies[id] = r;
+            });
+        };
+        auto has = [&](const std::string& id, const char* text) {
+            std::lock_guard<std::mutex> lock(m);
+            return replies[id].find(text) != std::string::npos;
+        };
+
+        send("fit", R"({"id": 1, "op": "fit", "params": {"series": 4, "parallel": 2}})");
+        send("fit_outline", R"({"id": 13, "op": "fit", "params": {"series": 4, "parallel": 2, "outline": "0,0 60,0 60,60 0,60"}})");
+        send("zero", R"({"id": 2, "op": "generate", "params": {"series": 0}})");
+        send("negative", R"({"id": 3, "op": "generate", "params": {"cell_dia": -1}})");
+        send("type", R"({"id": 4, "op": "generate", "params": {"series": [4]}})");
+        send("malformed", R"({"id": 5, "op": )");
+        send("op", R"({"id": 6, "op": "frobnicate"})");
+        send("bare", R"({"id": 14, "op": "fit", "params": {"series": 4x}})");
+        send("leading_zero", R"({"id": 15, "op": "fit", "params": {"series": 04}})");
+        send("pair", R"({"id": "\ud83d\ude00", "op": "close", "session": "x"})");
+        send("lone", R"({"id": "\ud83d", "op": "close", "session": "x"})");
+        send("session", R"({"id": 7, "op": "generate", "session": "../up"})");
+        send("absolute", R"({"id": 10, "op": "generate", "session": "t", "params": {"stl": "/tmp/x.stl"}})");
+        send("parent", R"({"id": 11, "op": "generate", "session": "t", "params": {"out": "sub/../../x"}})");
+        send("outline_dxf", R"({"id": 12, "op": "generate", "session": "t", "params": {"outline_dxf": "../other/plate.dxf"}})");
+        send("huge", R"({"id": 8, "op": "generate", "session": "t", "params": {"outline": "0,0 1e9,0 1e9,1e9 0,1e9"}})");
+        server.drain();
+        // the session keeps working after a rejected request
+        send("generate", R"({"id": 9, "op": "generate", "session": "t", "params": {"outline": "", "series": 4, "parallel": 2, "chord_tol_mm": 0.05}})");
+        server.drain();
+
+        CHECK(has("fit", "\"ok\": true") && has("fit", "\"fits\": true"));
+        // the outline, not the default 460 x 140 rectangle, decides
+        CHECK(has("fit_outline", "\"ok\": true") && has("fit_outline", "\"fits\": false") && has("fit_outline", "\"cells\": 4"));
+        CHECK(has("zero", "\"ok\": false") && has("zero", "\"key\": \"series\""));
+        CHECK(has("negative", "\"ok\": false") && has("negative", "\"key\": \"cell_dia\""));
+        CHECK(has("type", "\"ok\": false"));
+        CHECK(has("malformed", "malformed request"));
+        CHECK(has("op", "unknown op"));
+        CHECK(has("bare", "malformed request") && has("leading_zero", "malformed request"));
+        CHECK(has("pair", "\"id\": \"\xF0\x9F\x98\x80\""));
+        CHECK(has("lone", "malformed request"));
+        CHECK(has("session", "bad session"));
+        CHECK(has("absolute", "\"ok\": false") && has("absolute", "\"key\": \"stl\""));
+        CHECK(has("parent", "\"ok\": false") && has("parent", "\"key\": \"stl\""));
+        CHECK(has("outline_dxf", "\"ok\": false") && has("outline_dxf", "\"key\": \"outline_dxf\""));
+        CHECK(has("huge", "\"id\": 8, \"ok\": false"));
+        CHECK(has("generate", "\"id\": 9, \"ok\": true"));
+        CHECK(fs::exists(scratch / "server" / "t" / "cellholder.stl"));
+    }
+
+    void test_dxf_outline() {
+        // a closed LWPOLYLINE outline with a CIRCLE and a triangle of LINEs
+        // inside it as keep-outs, and one LINE left open
+        std::string dxf = "0\nSECTION\n2\nENTITIES\n"
+            "0\nLWPOLYLINE\n8\n0\n90\n4\n70\n1\n"
+            "10\n0\n20\n0\n10\n100\n20\n0\n10\n100\n20\n60\n10\n0\n20\n60\n"
+            "0\nCIRCLE\n8\n0\n10\n30\n20\n30\n40\n10\n"
+            "0\nLINE\n8\n0\n10\n60\n20\n20\n11\n80\n21\n20\n"
+            "0\nLINE\n8\n0\n10\n80\n20\n20\n11\n70\n21\n40\n"
+            "0\nLINE\n8\n0\n10\n70\n20\n40\n11\n60\n21\n20\n"
+            "0\nLINE\n8\n0\n10\n5\n20\n50\n11\n15\n21\n55\n"
+            "0\nENDSEC\n0\nEOF\n";
+        write_file(scratch / "outline.dxf", dxf);
+
+        dxf::Outline out;
+        std::string error;
+        CHECK(dxf::read_outline((scratch / "outline.dxf").string().c_str(), 0.01f, "", out, error));
+        CHECK(out.rings.size() == 3);
+        CHECK(out.open == 1 && out.outside == 0);
+        if(out.rings.size() == 3) {
+            CHECK(out.rings.count(0) == 4);
+            size_t circle = out.rings.count(1) > out.rings.count(2) ? 1 : 2;
+            CHECK(out.rings.count(circle) > 16 && out.rings.count(3 - circle) == 3);
+            for(const Vec2& v : out.rings[circle]) {
+                float dx = v.x - 30.f, dy = v.y - 30.f;
+                CHECK(std::abs(std::sqrt(dx * dx + dy * dy) - 10.f) < 0.02f);
+            }
+        }
+    }
+
+    // Layers and cells of each busbar, in drawing order.
+    void check_busbars(const dxf::Drawing& d, const std::vector<Vec2>& centers,
+        const std::vector<std::pair<const char*, std::vector<int>>>& expected) {
+        CHECK(d.polylines.size() == expected.size());
+        for(size_t i = 0; i < std::min(d.polylines.size(), expected.size()); ++i) {
+            CHECK(d.polylines[i].layer == expected[i].first);
+            for(size_t c = 0; c < centers.size(); ++c) {
+                bool want = std::find(expected[i].second.begin(), expected[i].second.end(), int(c)) != expected[i].second.end();
+                CHECK(inside(d.polylines[i].pts, centers[c]) == want);
+            }
+        }
+    }
+
+    void test_busbar_order() {
+        std::vector<Vec2> centers{ { 0, 0 }, { 20, 0 }, { 40, 0 }, { 60, 0 } };
+
+        // even series: B- on group 0, then the groups in pairs, B+ alone
+        std::vector<int> groups{ 0, 1, 2, 3 };
+        check_busbars(dxf::busbars_cell_groups(centers, groups, 4, 12.f, 2.f, 0.05f), centers,
+            { { "B-", { 0 } }, { "BUSBAR", { 1, 2 } }, { "B+", { 3 } } });
+
+        // groups need not follow the cell order
+        groups = { 3, 2, 1, 0 };
+        check_busbars(dxf::busbars_cell_groups(centers, groups, 4, 12.f, 2.f, 0.05f), centers,
+            { { "B-", { 3 } }, { "BUSBAR", { 1, 2 } }, { "B+", { 0 } } });
+
+        // odd series: B+ is the last group alone, drawn after the rest;
+        // cells on no group get no busbar
+        groups = { 0, 1, 2, -1 };
+        check_busbars(dxf::busbars_cell_groups(centers, groups, 3, 12.f, 2.f, 0.05f), centers,
+            { { "B-", { 0 } }, { "BUSBAR", { 1, 2 } }, { "B+", { 2 } } });
+    }
+
+    void* volatile escaped;     // keeps the compiler from eliding new/delete
+
+    // Profiling stays on once enabled, so this runs last.
+    void test_profiler() {
+        // freeing a block from before enable() leaves the live count alone
+        escaped = new char[1 << 20];
+        char* early = static_cast<char*>(escaped);
+        app::profile::enable();
+        int64_t live0 = app::profile::heap_live();
+        delete[] early;
+        CHECK(app::profile::heap_live() == live0);
+
+        // over-aligned blocks are counted both ways
+        struct alignas(64) Line { char b[64]; };
+        escaped = new Line[1000];
+        Line* lines = static_cast<Line*>(escaped);
+        CHECK(app::profile::heap_live() >= live0 + int64_t(sizeof(Line) * 1000));
+        CHECK(uintptr_t(lines) % alignof(Line) == 0);
+        delete[] lines;
+        CHECK(app::profile::heap_live() == live0);
+    }
+}
+
+int main(int argc, char** argv) {
+    bool keep = argc > 1 && std::strcmp(argv[1], "--keep") == 0;
+    scratch = fs::temp_directory_path() / "cellholder_tests";
+    std::error_code ec;
+    fs::remove_all(scratch, ec);
+    fs::create_directories(scratch);
+
+    const std::pair<const char*, std::function<void()>> tests[] = {
+        { "cache_entries", test_cache_entries },
+        { "cache_outputs", test_cache_outputs },
+        { "watertight", test_watertight },
+        { "stl_count", test_stl_count },
+        { "optimize_box", test_optimize_box },
+        { "sweep", test_sweep },
+        { "settings", test_settings },
+        { "server", test_server },
+        { "dxf_outline", test_dxf_outline },
+        { "busbar_order", test_busbar_order },
+        { "profiler", test_profiler },
+    };
+    for(const auto& [name, run] : tests) {
+        int before = failures;
+        run();
+        std::printf("%-16s %s\n", name, failures == before ? "ok" : "FAILED");
+    }
+
+    if(!keep) fs::remove_all(scratch, ec);
+    std::printf("%d failed check%s\n", failures, failures == 1 ? "" : "s");
+    return failures;
+}